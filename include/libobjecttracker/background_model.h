@@ -0,0 +1,66 @@
+#pragma once
+#include <cstddef>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+namespace libobjecttracker {
+
+  // Learns positions where markers show up persistently (reflections,
+  // fixtures, wands lying around) and removes markers at those positions
+  // from the frame before tracking. Positions are quantized into a spatial
+  // hash; a cell becomes background after it was seen in most of the last
+  // learnFrames frames and fades out again once it stays empty.
+  // Markers close to an object are never removed nor learned, so an
+  // object landing on a learned position is tracked normally, and an
+  // object waiting somewhere does not become background.
+  class BackgroundModel
+  {
+  public:
+    BackgroundModel(
+      float cellSize = 0.02,
+      uint32_t learnFrames = 200,
+      float exclusionMargin = 0.1);
+
+    // Updates the model with the markers of one frame and returns the
+    // markers that are not background. Markers within an exclusion sphere
+    // (center x, y, z and radius; the margin is added) are always kept
+    // and do not count towards the model.
+    // The input is returned as is if nothing was removed.
+    pcl::PointCloud<pcl::PointXYZ>::ConstPtr filter(
+      pcl::PointCloud<pcl::PointXYZ>::ConstPtr markers,
+      const std::vector<Eigen::Vector4f, Eigen::aligned_allocator<Eigen::Vector4f> >& exclusions);
+
+    // number of cells currently considered background
+    size_t size() const;
+
+    void clear();
+
+  private:
+    struct Cell
+    {
+      int32_t score;
+      uint32_t lastFrame;
+    };
+
+    uint64_t key(const pcl::PointXYZ& p) const;
+    bool excluded(const pcl::PointXYZ& p,
+      const std::vector<Eigen::Vector4f, Eigen::aligned_allocator<Eigen::Vector4f> >& exclusions) const;
+
+  private:
+    float m_cellSize;
+    int32_t m_learnFrames;
+    float m_exclusionMargin;
+    uint32_t m_frame;
+    std::unordered_map<uint64_t, Cell> m_cells;
+    // scratch space
+    std::vector<uint8_t> m_background;
+  };
+
+} // namespace libobjecttracker
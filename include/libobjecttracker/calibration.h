@@ -0,0 +1,61 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+namespace libobjecttracker {
+
+  // Estimates the marker configuration of one vehicle from recorded frames
+  // of it being moved around. Frames are expected to contain the vehicle
+  // and possibly other markers further away than linkDistance.
+  //
+  // Each frame's markers are clustered; frames where exactly one cluster
+  // has numMarkers markers are used. Markers are labeled by following
+  // them from the previous used frame, or, after a jump, by matching
+  // the first used frame: three of its markers are located by their
+  // distances to all others, and the rest are labeled by their nearest
+  // neighbor under the pose these three give. The configuration is then
+  // solved by generalized Procrustes analysis: all frames are aligned to
+  // the current mean shape, which is recomputed until it settles.
+  //
+  // The result is expressed relative to the markers' centroid, with the
+  // axes of the world frame at the first used frame, so the vehicle
+  // should start out level and facing +x.
+  class MarkerCalibrator
+  {
+  public:
+    MarkerCalibrator(size_t numMarkers,
+      float linkDistance = 0.1,
+      float tolerance = 0.005);
+
+    // returns false if the frame could not be used
+    bool addFrame(const pcl::PointCloud<pcl::PointXYZ>& markers);
+
+    size_t frames() const { return m_frames.size(); }
+
+    // returns false if no frame was added; rms is the root mean
+    // square distance of the frames' markers to the fitted configuration
+    bool solve(pcl::PointCloud<pcl::PointXYZ>& configuration, float& rms) const;
+
+  private:
+    bool cluster(const pcl::PointCloud<pcl::PointXYZ>& markers, Eigen::Matrix3Xf& points) const;
+    float distanceError(const Eigen::Matrix3Xf& points) const;
+    bool label(Eigen::Matrix3Xf& points) const;
+    bool labelExhaustive(Eigen::Matrix3Xf& points) const;
+    bool labelByAnchors(Eigen::Matrix3Xf& points) const;
+
+  private:
+    size_t m_numMarkers;
+    float m_linkDistance;
+    float m_tolerance;
+    // pairwise distances of the first frame
+    Eigen::MatrixXf m_referenceDistances;
+    // labeled markers of each used frame
+    std::vector<Eigen::Matrix3Xf> m_frames;
+  };
+
+} // namespace libobjecttracker
@@ -0,0 +1,48 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "libobjecttracker/object_tracker.h"
+
+namespace libobjecttracker {
+
+  // Binary cache of parsed configurations. Applications hash the raw
+  // configuration sources (e.g. the YAML files) with configurationHash;
+  // if a cache with the same hash exists, it is memory mapped and decoded
+  // instead of parsing the sources again. Since the hash only covers the
+  // sources, applications should include a version of their parser as
+  // one of them.
+  //
+  // cache format (native endianness):
+  // magic "LOTC", version               : uint32, uint32
+  // content hash                        : uint64
+  // #dynamics, #markers, #objects       : uint32 x 3
+  // dynamics configurations             : float64 x 9, numParticles
+  //                                       uint32 each (no padding)
+  // marker configuration sizes          : uint32 each
+  // [x y z, x y z, ...]                 : float32
+  // objects: marker idx, dynamics idx   : uint32 x 2
+  //          initial transformation     : float32 x 16 (column major)
+
+  // 64-bit FNV-1a over all sources
+  uint64_t configurationHash(const std::vector<std::string>& sources);
+
+  // returns false if the file does not exist, is malformed,
+  // or was built from different sources
+  bool loadConfigurationCache(
+    const std::string& path,
+    uint64_t hash,
+    std::vector<DynamicsConfiguration>& dynamicsConfigurations,
+    std::vector<MarkerConfiguration>& markerConfigurations,
+    std::vector<Object>& objects);
+
+  // throws std::runtime_error if the file cannot be written
+  void writeConfigurationCache(
+    const std::string& path,
+    uint64_t hash,
+    const std::vector<DynamicsConfiguration>& dynamicsConfigurations,
+    const std::vector<MarkerConfiguration>& markerConfigurations,
+    const std::vector<Object>& objects);
+
+} // namespace libobjecttracker
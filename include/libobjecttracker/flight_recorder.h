@@ -0,0 +1,128 @@
+#pragma once
+#include <cstddef>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include "state_persister.h"
+
+namespace libobjecttracker {
+
+  class Object;
+
+  // Keeps the last numFrames input frames and the tracker state before
+  // each of them in memory, and writes them out when a tracking incident
+  // happens. All buffers are allocated up front (frames with more than
+  // maxMarkers markers are truncated); nothing is allocated per frame
+  // unless the number of objects changes.
+  //
+  // After a trigger, postTriggerFrames more frames are recorded, then the
+  // buffer is handed to a background thread (a second buffer takes over
+  // recording) which writes
+  //   <pathPrefix><n>.log   : the frames, in the cloud log format
+  //                           (see cloudlog.hpp), for PointCloudPlayer
+  //   <pathPrefix><n>.state : the state before the first frame, for
+  //                           ObjectTracker::restoreState (see readState),
+  //                           with stamps relative to the log's first
+  //                           frame, i.e. restore with now and wallNow
+  //                           both at time_point()
+  //   <pathPrefix><n>.csv   : per frame: latency, valid objects, triggers
+  // Incidents while the previous one is still being written are dropped.
+  // recordInput/recordOutput are called from ObjectTracker::update()
+  // and never block.
+  class FlightRecorder
+  {
+  public:
+    enum Trigger : uint32_t
+    {
+      ObjectLost = 1,           // a valid object became invalid
+      InitializationFailed = 2,
+      LatencySpike = 4,         // update() took longer than the threshold
+      AllTriggers = 7,
+    };
+
+    FlightRecorder(const std::string& pathPrefix,
+      size_t numFrames = 500,
+      size_t maxMarkers = 1024);
+    ~FlightRecorder();
+
+    // bitmask of Trigger (default: AllTriggers)
+    void setTriggers(uint32_t triggers);
+
+    // in seconds (default: 0.02)
+    void setLatencyThreshold(double seconds);
+
+    // default: a tenth of the frames
+    void setPostTriggerFrames(size_t frames);
+
+    // incidents written / dropped so far
+    size_t incidents() const { return m_incidents; }
+    size_t droppedIncidents() const { return m_droppedIncidents; }
+
+    void recordInput(std::chrono::high_resolution_clock::time_point stamp,
+      const pcl::PointCloud<pcl::PointXYZ>& markers,
+      const std::vector<Object>& objects);
+
+    void recordOutput(const std::vector<Object>& objects,
+      double latency,
+      bool initializationFailed);
+
+  private:
+    struct Frame
+    {
+      int64_t stamp; // nanoseconds since clock epoch
+      float latency;
+      uint32_t validObjects;
+      uint32_t triggers;
+      uint32_t numMarkers;
+      std::vector<float> xyz;
+      std::vector<ObjectState> states;
+    };
+
+    struct Buffer
+    {
+      std::vector<Frame> frames;
+      size_t next;
+      size_t count;
+    };
+
+    void run();
+    void writeIncident(Buffer& buffer, size_t incident);
+
+  private:
+    std::string m_pathPrefix;
+    size_t m_maxMarkers;
+    uint32_t m_triggers;
+    double m_latencyThreshold;
+    size_t m_postTriggerFrames;
+
+    // only touched by the tracker thread
+    Buffer* m_recording;
+    std::vector<uint8_t> m_lastValid;
+    // frames left until the incident is written, -1 if none
+    long m_countdown;
+    // new incidents are only started once the buffer holds new frames
+    size_t m_holdoff;
+
+    // handed over to the writer
+    Buffer m_buffers[2];
+    Buffer* m_writing;
+    size_t m_nextIncident;
+    std::atomic<size_t> m_incidents;
+    std::atomic<size_t> m_droppedIncidents;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_running;
+    std::thread m_thread;
+  };
+
+} // namespace libobjecttracker
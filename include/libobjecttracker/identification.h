@@ -0,0 +1,75 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <Eigen/StdVector>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+namespace libobjecttracker {
+
+  // a cluster of frame markers recognized as one marker configuration
+  struct Identification
+  {
+    size_t markerConfigurationIdx;
+    Eigen::Affine3f transformation;
+    // mean squared distance of the configuration's markers to the cluster
+    float fitness;
+    // indices of the cluster's markers in the frame
+    std::vector<int> markers;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  };
+
+  // Recognizes marker configurations in a frame by their geometry alone.
+  // Each configuration is described by its sorted pairwise marker
+  // distances (its signature) and, per marker, the sorted distances to
+  // the other markers. The frame is split into clusters of markers that
+  // are closer to each other than markers within any configuration; each
+  // cluster is looked up by marker count and diameter in the index, its
+  // signature compared, and the pose solved from the per-marker
+  // descriptors. Works anywhere in the arena, without initial positions.
+  class ConfigurationIndex
+  {
+  public:
+    ConfigurationIndex(
+      const std::vector<pcl::PointCloud<pcl::PointXYZ>::Ptr>& markerConfigurations,
+      float tolerance = 0.005);
+
+    std::vector<Identification, Eigen::aligned_allocator<Identification> > identify(
+      const pcl::PointCloud<pcl::PointXYZ>& markers) const;
+
+  private:
+    struct Descriptor
+    {
+      size_t markerConfigurationIdx;
+      float diameter;
+      Eigen::VectorXf signature;
+      // column i: sorted distances of marker i to the other markers
+      Eigen::MatrixXf markerSignatures;
+      Eigen::Matrix3Xf points;
+    };
+
+    static Eigen::VectorXf signature(const Eigen::Matrix3Xf& points);
+    static Eigen::MatrixXf markerSignatures(const Eigen::Matrix3Xf& points);
+
+    void clusters(const pcl::PointCloud<pcl::PointXYZ>& markers,
+      std::vector<std::vector<int> >& result) const;
+
+    bool solvePose(const Descriptor& descriptor,
+      const Eigen::Matrix3Xf& cluster,
+      Eigen::Affine3f& transformation,
+      float& fitness) const;
+
+  private:
+    float m_tolerance;
+    // markers of one object are at most this far from their nearest neighbor
+    float m_linkDistance;
+    // sorted by marker count, then diameter
+    std::vector<Descriptor> m_descriptors;
+  };
+
+} // namespace libobjecttracker
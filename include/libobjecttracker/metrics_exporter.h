@@ -0,0 +1,75 @@
+#pragma once
+#include <cstddef>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace libobjecttracker {
+
+  class Object;
+
+  // Collects tracker health statistics and exports them in the Prometheus
+  // text format, either over HTTP on a localhost socket or by rewriting a
+  // file periodically. All exporting happens on a background thread;
+  // the record* functions are called from ObjectTracker::update() and
+  // never block.
+  class MetricsExporter
+  {
+  public:
+    MetricsExporter();
+    ~MetricsExporter();
+
+    // serve metrics on http://127.0.0.1:<port>/
+    void serve(uint16_t port);
+
+    // atomically rewrite <path> every <period>
+    void writeFile(const std::string& path, std::chrono::milliseconds period);
+
+    void stop();
+
+    void recordFrame(std::chrono::high_resolution_clock::time_point stamp,
+      double latency,
+      const std::vector<Object>& objects);
+
+    void recordInitialization(bool success);
+
+    void recordWarning();
+
+    std::string render();
+
+  private:
+    void start();
+    void run();
+    void serveClient(int fd);
+    void writeFileNow();
+
+  private:
+    // number of frames used for frame rate and latency percentiles
+    static const size_t Window = 1024;
+
+    std::atomic<uint64_t> m_frames;
+    std::atomic<uint64_t> m_initializations;
+    std::atomic<uint64_t> m_initializationFailures;
+    std::atomic<uint64_t> m_warnings;
+    std::atomic<uint64_t> m_objectsLost;
+    std::atomic<float> m_latencies[Window];
+    std::atomic<int64_t> m_stamps[Window];
+
+    // per-object validity, copied under try_lock by the tracker
+    std::mutex m_validMutex;
+    std::vector<uint8_t> m_valid;
+    // only touched by the tracker thread
+    std::vector<uint8_t> m_lastValid;
+
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    int m_listenFd;
+    std::string m_path;
+    std::chrono::milliseconds m_period;
+  };
+
+} // namespace libobjecttracker
@@ -2,10 +2,18 @@
 #include <cstddef>
 #include <stdint.h>
 #include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
 
+#include "pose_history.h"
+#include "registration.h"
+
 namespace libobjecttracker {
 
   struct DynamicsConfiguration
@@ -19,18 +27,62 @@ namespace libobjecttracker {
     double maxRoll;
     double maxPitch;
     double maxFitnessScore;
+    // > 0: track with a particle filter of this many particles instead of
+    // the registration, for objects that are mostly occluded (see
+    // particle_filter.h); capped at ParticleFilter::MaxParticles.
+    // Defaults to 0 (registration), so code that fills only the other
+    // fields keeps its behavior.
+    uint32_t numParticles = 0;
   };
 
+  // Motion model used by the tracker: true if next is reachable from last
+  // within dt under dynConf and fitness is good enough. If failure is
+  // given, it receives the violated limits.
+  bool checkDynamics(const DynamicsConfiguration& dynConf,
+    const Eigen::Affine3f& last,
+    const Eigen::Affine3f& next,
+    double dt,
+    float fitness,
+    std::string* failure = nullptr);
+
   class ObjectTracker;
   class PointCloudDebugger;
+  class MetricsExporter;
+  class StatePersister;
+  class PosePredictor;
+  class BackgroundModel;
+  class Preprocessor;
+  class ConfigurationIndex;
+  class ParticleFilter;
+  class FlightRecorder;
+  struct ObjectState;
+
+  // One candidate pose of an object with a symmetric marker
+  // configuration, see ObjectTracker::setMaxPoseHypotheses.
+  struct PoseHypothesis
+  {
+    Eigen::Affine3f transformation;
+    // decaying sum of the registration fitness, lower is better
+    float cost;
+    uint32_t markersUsed;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  };
+
   class Object
   {
   public:
+    // marks markers without a label, and model markers not bound to one
+    static const uint32_t NoLabel = 0xffffffff;
+
     Object(
       size_t markerConfigurationIdx,
       size_t dynamicsConfigurationIdx,
       const Eigen::Affine3f& initialTransformation);
 
+    size_t markerConfigurationIdx() const { return m_markerConfigurationIdx; }
+    size_t dynamicsConfigurationIdx() const { return m_dynamicsConfigurationIdx; }
+
     const Eigen::Affine3f& transformation() const;
     Eigen::Vector3f center() const { return m_lastTransformation.translation(); }
 
@@ -39,18 +91,58 @@ namespace libobjecttracker {
 
     bool lastTransformationValid() const;
 
+    // false once the object was removed from the tracker
+    bool active() const { return m_active; }
+
     std::chrono::time_point<std::chrono::high_resolution_clock> lastValidTime() const {
       return m_lastValidTransform;
     }
 
+    Eigen::Vector3f velocity() const { return m_velocity; }
+
+    // bit i is set if marker i of the configuration was used
+    // for the last valid pose (first 32 markers only)
+    uint32_t markersUsed() const { return m_markersUsed; }
+
+    // the latest valid poses, see ObjectTracker::setPoseHistoryCapacity
+    const PoseHistory& history() const { return m_history; }
+
+    // the poses the object could have given the symmetries of its marker
+    // configuration; the first one is transformation(). Empty unless
+    // enabled, see ObjectTracker::setMaxPoseHypotheses
+    const std::vector<PoseHypothesis, Eigen::aligned_allocator<PoseHypothesis> >& hypotheses() const {
+      return m_hypotheses;
+    }
+
+    // per marker of the configuration: the label of the frame marker it
+    // is bound to, or NoLabel. Only filled by the labeled update().
+    const std::vector<uint32_t>& markerLabels() const { return m_markerLabels; }
+
   private:
     size_t m_markerConfigurationIdx;
     size_t m_dynamicsConfigurationIdx;
     Eigen::Affine3f m_lastTransformation;
-    const Eigen::Affine3f m_initialTransformation;
+    Eigen::Affine3f m_initialTransformation;
     Eigen::Vector3f m_velocity;
     std::chrono::time_point<std::chrono::high_resolution_clock> m_lastValidTransform;
+    // stamp of m_lastTransformation; behind m_lastValidTransform while
+    // the pose is held by the stationary check
+    std::chrono::time_point<std::chrono::high_resolution_clock> m_lastPoseChange;
     bool m_lastTransformationValid;
+    bool m_active;
+    bool m_awaitingInitialization;
+    // m_velocity came from restoreState and is kept through the first
+    // update, which would otherwise measure it over the restart gap
+    bool m_velocityRestored;
+    uint32_t m_markersUsed;
+    PoseHistory m_history;
+    std::vector<PoseHypothesis, Eigen::aligned_allocator<PoseHypothesis> > m_hypotheses;
+    // created when the object is added or the configurations change,
+    // see DynamicsConfiguration::numParticles
+    std::shared_ptr<ParticleFilter> m_particleFilter;
+    std::vector<uint32_t> m_markerLabels;
+    // set if the last update() used the label bindings
+    bool m_trackedByLabels;
 
     friend ObjectTracker;
     friend PointCloudDebugger;
@@ -58,6 +150,21 @@ namespace libobjecttracker {
 
   typedef pcl::PointCloud<pcl::PointXYZ>::Ptr MarkerConfiguration;
 
+  // body frame transformations S that map a marker configuration onto
+  // itself, i.e. the poses T and T * S explain the same markers
+  typedef std::vector<Eigen::Affine3f, Eigen::aligned_allocator<Eigen::Affine3f> > MarkerConfigurationSymmetries;
+
+  // Pose of one object as of the last update(), referring directly to
+  // storage owned by the tracker (valid until the next update()).
+  struct PoseView
+  {
+    size_t id; // index in ObjectTracker::objects()
+    Eigen::Map<const Eigen::Vector3f> position;
+    Eigen::Map<const Eigen::Quaternionf> orientation;
+    bool valid;
+    std::chrono::high_resolution_clock::time_point stamp; // of the last pose change
+  };
+
   class ObjectTracker
   {
   public:
@@ -65,6 +172,7 @@ namespace libobjecttracker {
       const std::vector<DynamicsConfiguration>& dynamicsConfigurations,
       const std::vector<MarkerConfiguration>& markerConfigurations,
       const std::vector<Object>& objects);
+    ~ObjectTracker();
 
     void update(
       pcl::PointCloud<pcl::PointXYZ>::Ptr pointCloud);
@@ -73,28 +181,346 @@ namespace libobjecttracker {
     void update(std::chrono::high_resolution_clock::time_point stamp,
       pcl::PointCloud<pcl::PointXYZ>::Ptr pointCloud);
 
+    // For sources that label markers consistently across frames. Each
+    // object's markers are bound to the labels found at its pose; while
+    // the bound labels are present (all of them, or as many as
+    // setMinVisibleMarkers requires) and fit the configuration within
+    // setMarkerLabelTolerance, the pose is solved from them directly,
+    // without any search. Other objects, and objects whose labels
+    // changed, are tracked as in the unlabeled update() and bound again.
+    // Labeled positions are used as delivered, without the preprocessor;
+    // labels given to several markers, and Object::NoLabel, are ignored.
+    void update(std::chrono::high_resolution_clock::time_point stamp,
+      pcl::PointCloud<pcl::PointXYZL>::ConstPtr labeledCloud);
+
     const std::vector<Object>& objects() const;
 
+    // Calls visitor(const PoseView&) for each active object, or, if
+    // changedOnly is set, only for objects that got a new pose or lost
+    // tracking in the last update().
+    template <typename Visitor>
+    void visitPoses(Visitor&& visitor, bool changedOnly = false) const
+    {
+      for (size_t i = 0; i < m_poseValid.size(); ++i) {
+        if (!m_poseActive[i] || (changedOnly && !m_poseChanged[i])) {
+          continue;
+        }
+        PoseView view = {
+          i,
+          Eigen::Map<const Eigen::Vector3f>(&m_posePositions[3 * i]),
+          Eigen::Map<const Eigen::Quaternionf>(&m_poseOrientations[4 * i]),
+          m_poseValid[i] != 0,
+          m_poseStamps[i]};
+        visitor(view);
+      }
+    }
+
+    // Objects can be added and removed while tracking. Changes take effect
+    // at the beginning of the next update(); only added objects are
+    // initialized, all other objects keep their state and index.
+    // addObject returns the index the object will have in objects(),
+    // removed objects stay in objects() as inactive until their index
+    // is reused by a later addObject. Objects referring to a marker or
+    // dynamics configuration that does not exist are rejected with a
+    // warning, and InvalidObject is returned.
+    static const size_t InvalidObject = (size_t)-1;
+    size_t addObject(const Object& object);
+    void removeObject(size_t idx);
+
+    // Reserves room for count objects, so that objects() is not
+    // reallocated (and references into it stay valid) while fewer
+    // objects are added. Call between updates.
+    void reserveObjects(size_t count);
+
+    // Replaces the dynamics and marker configuration tables. The tables are
+    // copied on the calling thread and swapped in at the beginning of the
+    // next update(); tracked poses are kept. The identification index and
+    // the symmetries (if enabled) are built here, on the calling thread.
+    void setConfigurations(
+      const std::vector<DynamicsConfiguration>& dynamicsConfigurations,
+      const std::vector<MarkerConfiguration>& markerConfigurations);
+
     void setLogWarningCallback(
       std::function<void(const std::string&)> logWarn);
 
+    // number of threads used to track objects in parallel (default: 1);
+    // the calling thread is one of them, the others are started here
+    // and kept until the next call
+    void setNumThreads(size_t numThreads);
+
+    // number of valid poses kept per object in Object::history()
+    // (default: PoseHistory::DefaultCapacity). Clears the histories.
+    void setPoseHistoryCapacity(size_t capacity);
+
+    // Identify objects by the geometry of their marker configuration
+    // during initialization (default: off): an object is initialized from
+    // a cluster of markers matching its configuration anywhere in the
+    // arena. If several objects share a configuration, clusters are
+    // assigned to them jointly by distance to their initial positions,
+    // closest pairs first. Objects without a matching cluster are
+    // initialized around their initial position as before.
+    // tolerance (in m) is the allowed error of marker distances.
+    // See identification.h.
+    void setIdentification(bool enable, double tolerance = 0.005);
+
+    // weighting of correspondences in the per-object registration
+    // (default: RobustLoss::None), see registration.h
+    void setRobustLoss(RobustLoss loss, double parameter);
+
+    // Accept fits that use only some of an object's markers (default: all
+    // markers are required; 0 restores that). A matched marker counts as
+    // visible if its distances to the other visible markers match the
+    // configuration within tolerance (in m); the pose is then fit to the
+    // visible markers only. See Object::markersUsed.
+    void setMinVisibleMarkers(size_t count, double tolerance = 0.005);
+
+    // Track up to count pose hypotheses per object whose marker
+    // configuration is (nearly) symmetric under a rotation about its
+    // vertical axis, within symmetryTolerance (in m) per marker
+    // (default: 1, off). Each hypothesis is registered every frame and
+    // dropped if it fails the dynamics check against its own last pose;
+    // the one with the lowest decaying fitness sum is reported, switching
+    // only if it is clearly better. Symmetric counterparts of the reported
+    // pose are added again, so a wrong choice is corrected without
+    // reinitialization. See Object::hypotheses.
+    void setMaxPoseHypotheses(size_t count, double symmetryTolerance = 0.01);
+
+    // An object whose markers are all found within this distance (in m)
+    // of their last position keeps its pose without registration
+    // (e.g. 1mm), so very slow motion is reported in steps of up to this
+    // size. Velocity and the time step of the next registration are taken
+    // from the last pose that changed, and visitPoses(changedOnly) skips
+    // held objects. 0 disables the check (default).
+    void setStationaryThreshold(double distance);
+
+    // Track each model marker of a valid object by its nearest frame
+    // marker within this distance (in m) of its predicted position (last
+    // pose moved by the velocity), and fit the pose to these pairs in
+    // closed form, without registration iterations (default: 0, off).
+    // Objects whose association is ambiguous (no marker, or more than
+    // one, within the gate; a frame marker claimed twice; a residual
+    // above the gate after the fit) or that fail the dynamics check fall
+    // back to the registration. Objects with pose hypotheses or a
+    // particle filter always use those. Set it to a few times the
+    // expected per-frame marker motion.
+    void setMarkerAssociationGate(double distance);
+
+    // largest residual (in m) of a labeled marker, both for binding
+    // labels and for solving from them (default: 5mm)
+    void setMarkerLabelTolerance(double distance);
+
+    // The correspondence gate of an object grows with the time since its
+    // last valid pose, up to this interval (default: 1s). Objects lost
+    // for longer are only searched for within that bound.
+    void setMaxGatingInterval(double seconds);
+
+    // optional; see metrics_exporter.h
+    void setMetricsExporter(
+      std::shared_ptr<MetricsExporter> metrics);
+
+    // optional; see state_persister.h
+    void setStatePersister(
+      std::shared_ptr<StatePersister> persister);
+
+    // optional; see preprocessor.h. Without, only NaN/inf are removed.
+    void setPreprocessor(
+      std::shared_ptr<Preprocessor> preprocessor);
+
+    // optional; see background_model.h
+    void setBackgroundModel(
+      std::shared_ptr<BackgroundModel> background);
+
+    // optional; see pose_predictor.h
+    void setPosePredictor(
+      std::shared_ptr<PosePredictor> predictor);
+
+    // optional; see flight_recorder.h
+    void setFlightRecorder(
+      std::shared_ptr<FlightRecorder> recorder);
+
+    // Seeds tracking from a persisted state (see readState), e.g. after a
+    // restart. Objects whose state is younger than maxAge continue from
+    // their saved pose, extrapolated with their saved velocity, without
+    // initialization; all others are initialized individually. The age
+    // is measured on the wall clock (wallNow), since the tracker's clock
+    // may restart with the host; now is the tracker stamp of wallNow.
+    // The saved velocity is kept until the first valid update.
+    // Call before the first update(). Returns false if no object
+    // could be restored.
+    bool restoreState(
+      const std::vector<ObjectState>& states,
+      std::chrono::high_resolution_clock::time_point now,
+      std::chrono::high_resolution_clock::duration maxAge,
+      std::chrono::system_clock::time_point wallNow = std::chrono::system_clock::now());
+
   private:
+    struct TrackingContext;
+    struct WorkerPool;
+
+    // runs the preprocessor and the background model
+    pcl::PointCloud<pcl::PointXYZ>::ConstPtr preprocess(
+      pcl::PointCloud<pcl::PointXYZ>::ConstPtr pointCloud);
+
     void runICP(std::chrono::high_resolution_clock::time_point stamp,
       const pcl::PointCloud<pcl::PointXYZ>::ConstPtr markers);
 
+    // registration kernels are instantiated per marker count
+    // (4 or Eigen::Dynamic), see registration.h
+    void trackObjects(std::chrono::high_resolution_clock::time_point stamp);
+
+    template <int NumMarkers>
+    void trackObject(TrackingContext& context, Object& object,
+      std::chrono::high_resolution_clock::time_point stamp);
+
+    // refits to the markers whose correspondences agree with the
+    // configuration's distance table; false if too few are left
+    template <int NumMarkers>
+    bool fitVisibleMarkers(
+      const RigidRegistration<float, NumMarkers>& registration,
+      const Object& object,
+      Eigen::Affine3f& transformation,
+      float& fitness,
+      uint32_t& markersUsed) const;
+
+    // single-pass tracking, see setMarkerAssociationGate; false if the
+    // object has to be registered instead
+    template <int NumMarkers>
+    bool trackAssociatedMarkers(TrackingContext& context, Object& object,
+      std::chrono::high_resolution_clock::time_point stamp,
+      double dt);
+
+    // solves the pose from the bound labels, see the labeled update();
+    // false if the object has to be tracked without them
+    template <int NumMarkers>
+    bool trackLabeledMarkers(Object& object,
+      std::chrono::high_resolution_clock::time_point stamp,
+      double dt);
+
+    // binds the labels of valid objects not tracked by their labels
+    void bindMarkerLabels();
+
+    // tracks the object's pose hypotheses, see setMaxPoseHypotheses
+    template <int NumMarkers>
+    void trackHypotheses(RigidRegistration<float, NumMarkers>& registration,
+      Object& object,
+      std::chrono::high_resolution_clock::time_point stamp,
+      double dt);
+
+    // tracks the object with its particle filter instead of the
+    // registration, see DynamicsConfiguration::numParticles
+    void trackParticles(TrackingContext& context, Object& object,
+      std::chrono::high_resolution_clock::time_point stamp,
+      double dt);
+
+
+    // sorts the active objects by kernel, see trackObjects
+    void updateKernelBuckets();
+
+    // creates the particle filters of the objects that use one, and
+    // drops all others, so trackParticles never allocates
+    void updateParticleFilters();
+
     bool initialize(
+      pcl::PointCloud<pcl::PointXYZ>::ConstPtr markers,
+      const std::vector<size_t>& objectIndices);
+
+    // index in m_labeledMarkers of the marker with label in the current
+    // frame, -1 if there is none or several
+    int labeledMarker(uint32_t label) const;
+
+    // largest distance of an object being initialized from its
+    // initial position
+    float maxInitializationDeviation(
+      const std::vector<size_t>& objectIndices) const;
+
+    // initializes the objects that can be identified, removes their
+    // markers and returns the objects that are left
+    std::vector<size_t> initializeIdentifiedObjects(
+      pcl::PointCloud<pcl::PointXYZ>::Ptr markers,
+      const std::vector<size_t>& objectIndices);
+
+    void initializeAddedObjects(
       pcl::PointCloud<pcl::PointXYZ>::ConstPtr markers);
 
+    void applyPendingChanges();
+
+    // refreshes the storage behind visitPoses
+    void updatePoseViews();
+
     void logWarn(const std::string& msg);
 
   private:
     std::vector<MarkerConfiguration> m_markerConfigurations;
+    // precomputed per marker configuration
+    std::vector<float> m_markerConfigurationRadii;
+    std::vector<Eigen::MatrixXf> m_markerConfigurationDistances;
     std::vector<DynamicsConfiguration> m_dynamicsConfigurations;
     std::vector<Object> m_objects;
     bool m_initialized;
     int m_init_attempts;
+    size_t m_numThreads;
+    std::unique_ptr<WorkerPool> m_workers;
+    // per thread
+    std::vector<std::unique_ptr<TrackingContext> > m_contexts;
+    float m_maxGatingInterval;
+    size_t m_poseHistoryCapacity;
+    float m_stationaryThreshold;
+    float m_markerAssociationGate;
+    float m_markerLabelTolerance;
+    // labeled markers of the current frame, only during the labeled update()
+    bool m_hasLabels;
+    pcl::PointCloud<pcl::PointXYZ>::Ptr m_labeledMarkers;
+    std::vector<uint32_t> m_frameLabels;
+    // (label, index in m_labeledMarkers) sorted by label, index -1 if
+    // the label is not unique; see labeledMarker()
+    std::vector<std::pair<uint32_t, int> > m_labelIndex;
+    RobustLoss m_robustLoss;
+    float m_robustLossParameter;
+    size_t m_minVisibleMarkers;
+    float m_visibleMarkerTolerance;
+    size_t m_maxPoseHypotheses;
+    float m_symmetryTolerance;
+    // per marker configuration, only if pose hypotheses are enabled
+    std::vector<MarkerConfigurationSymmetries> m_markerConfigurationSymmetries;
+    std::vector<size_t> m_fixedSizeObjects;
+    std::vector<size_t> m_dynamicSizeObjects;
+
+    // per object, see visitPoses
+    std::vector<float> m_posePositions;    // x, y, z
+    std::vector<float> m_poseOrientations; // quaternion x, y, z, w
+    std::vector<uint8_t> m_poseValid;
+    std::vector<uint8_t> m_poseActive;
+    std::vector<uint8_t> m_poseChanged;
+    std::vector<std::chrono::high_resolution_clock::time_point> m_poseStamps;
 
     std::function<void(const std::string&)> m_logWarn;
+    std::mutex m_logWarnMutex;
+    std::shared_ptr<MetricsExporter> m_metrics;
+    std::shared_ptr<StatePersister> m_statePersister;
+    std::shared_ptr<PosePredictor> m_posePredictor;
+    std::shared_ptr<Preprocessor> m_preprocessor;
+    std::shared_ptr<FlightRecorder> m_flightRecorder;
+    // set if an initialization failed during the current update
+    bool m_initializationFailed;
+    std::shared_ptr<BackgroundModel> m_background;
+    // built from the marker configurations if identification is enabled
+    std::shared_ptr<ConfigurationIndex> m_configurationIndex;
+    float m_identificationTolerance;
+    std::vector<Eigen::Vector4f, Eigen::aligned_allocator<Eigen::Vector4f> > m_objectSpheres;
+
+    // objects added / removed since the last update
+    std::mutex m_pendingMutex;
+    std::vector<std::pair<size_t, Object> > m_pendingAdds;
+    std::vector<size_t> m_pendingRemoves;
+    std::vector<size_t> m_freeSlots;
+    size_t m_numSlots;
+    std::vector<DynamicsConfiguration> m_pendingDynamicsConfigurations;
+    std::vector<MarkerConfiguration> m_pendingMarkerConfigurations;
+    std::vector<float> m_pendingMarkerConfigurationRadii;
+    std::vector<Eigen::MatrixXf> m_pendingMarkerConfigurationDistances;
+    std::shared_ptr<ConfigurationIndex> m_pendingConfigurationIndex;
+    std::vector<MarkerConfigurationSymmetries> m_pendingMarkerConfigurationSymmetries;
+    bool m_hasPendingConfigurations;
   };
 
 } // namespace libobjecttracker
@@ -0,0 +1,96 @@
+#pragma once
+#include <cstddef>
+#include <stdint.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+namespace libobjecttracker {
+
+  struct DynamicsConfiguration;
+
+  // Tracks the pose of one object as a set of particles, for objects
+  // that are mostly occluded: unlike the registration, a single visible
+  // marker still constrains the pose. Particles are kept as arrays per
+  // component, so the motion and the marker prediction are evaluated for
+  // all particles at once. Each frame, particles move by the object's
+  // velocity plus noise of a third of the dynamics limits (velocity and
+  // rotation rates) over the time since the last update, at most
+  // maxInterval. Each model marker then contributes a
+  // Gaussian in the distance to its nearest frame marker, found through
+  // a uniform grid of the markerSigma * 3 cutoff, or a constant floor if
+  // none is closer. Particles are resampled when the effective sample
+  // size drops below half.
+  class ParticleFilter
+  {
+  public:
+    // particle counts are capped here, so the cost per object is bounded
+    static const size_t MaxParticles = 4096;
+
+    ParticleFilter(size_t numParticles, float markerSigma = 0.003);
+
+    // all particles at pose, as of stamp
+    void reset(const Eigen::Affine3f& pose,
+      std::chrono::high_resolution_clock::time_point stamp);
+
+    // weighted mean of the particles after the last update
+    // that matched any marker
+    const Eigen::Affine3f& estimate() const { return m_estimate; }
+
+    size_t size() const { return m_x.size(); }
+
+    // Returns the number of model markers that have a frame marker within
+    // the cutoff at the new estimate. If there are none, the estimate is
+    // kept and the particles carry the grown uncertainty to the next
+    // update. fitness is the mean squared distance of these markers.
+    // markersUsed has bit i set for model marker i (first 32 markers only).
+    size_t update(const pcl::PointCloud<pcl::PointXYZ>& model,
+      const pcl::PointCloud<pcl::PointXYZ>& markers,
+      const Eigen::Vector3f& velocity,
+      const DynamicsConfiguration& dynConf,
+      std::chrono::high_resolution_clock::time_point stamp,
+      float maxInterval,
+      float& fitness,
+      uint32_t& markersUsed);
+
+  private:
+    void buildGrid(const pcl::PointCloud<pcl::PointXYZ>& markers);
+    // squared distance to the nearest marker within the cutoff, or -1
+    float nearestSqrDist(const Eigen::Vector3f& p) const;
+    void resample();
+
+  private:
+    typedef Eigen::ArrayXf Array;
+
+    float m_markerSigma;
+    float m_cutoff;
+    // particles: position and orientation quaternion
+    Array m_x, m_y, m_z;
+    Array m_qx, m_qy, m_qz, m_qw;
+    Array m_logWeights;
+    Array m_weights;
+    Eigen::Affine3f m_estimate;
+    std::chrono::high_resolution_clock::time_point m_stamp;
+    std::minstd_rand m_random;
+
+    // grid of the frame markers, sorted by cell
+    float m_cellSize;
+    Eigen::Vector3f m_gridOrigin;
+    Eigen::Vector3i m_gridSize;
+    std::vector<int> m_cellStart; // per cell, plus one past the end
+    std::vector<Eigen::Vector3f, Eigen::aligned_allocator<Eigen::Vector3f> > m_gridMarkers;
+    std::vector<int> m_markerCells;
+    std::vector<int> m_cellFill;
+
+    // scratch space for resampling
+    std::vector<int> m_resampled;
+    Array m_scratch;
+  };
+
+} // namespace libobjecttracker
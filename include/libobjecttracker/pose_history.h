@@ -0,0 +1,62 @@
+#pragma once
+#include <cstddef>
+#include <chrono>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <Eigen/StdVector>
+
+namespace libobjecttracker {
+
+  // Fixed-capacity ring of timestamped poses of one object. The storage is
+  // allocated once; append() overwrites the oldest entry when full.
+  class PoseHistory
+  {
+  public:
+    typedef std::chrono::high_resolution_clock::time_point TimePoint;
+
+    struct Entry
+    {
+      TimePoint stamp;
+      Eigen::Vector3f position;
+      Eigen::Quaternionf orientation;
+
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    };
+
+    explicit PoseHistory(size_t capacity = DefaultCapacity);
+
+    // O(1). Entries must be appended in time order;
+    // entries not newer than the latest one are ignored.
+    void append(TimePoint stamp, const Eigen::Affine3f& pose);
+
+    void clear();
+
+    size_t size() const { return m_size; }
+    size_t capacity() const { return m_entries.size(); }
+    bool empty() const { return m_size == 0; }
+
+    // i = 0 is the oldest entry, size() - 1 the latest
+    const Entry& operator[](size_t i) const;
+    const Entry& latest() const { return (*this)[m_size - 1]; }
+
+    // Pose at the given time, in O(log n): SLERP / linear interpolation
+    // between the two surrounding entries, or extrapolation from the two
+    // latest entries for at most maxExtrapolation past the latest entry.
+    // Returns false if stamp is older than the oldest entry, too far in
+    // the future, or the history is empty.
+    bool poseAt(TimePoint stamp,
+      Eigen::Affine3f& pose,
+      std::chrono::high_resolution_clock::duration maxExtrapolation = std::chrono::milliseconds(100)) const;
+
+    static const size_t DefaultCapacity = 32;
+
+  private:
+    std::vector<Entry, Eigen::aligned_allocator<Entry> > m_entries;
+    // index of the next entry to write
+    size_t m_head;
+    size_t m_size;
+  };
+
+} // namespace libobjecttracker
@@ -0,0 +1,80 @@
+#pragma once
+#include <cstddef>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "triple_buffer.h"
+
+namespace libobjecttracker {
+
+  class Object;
+
+  // Predicted poses of all objects at one point in time, one array entry
+  // per object (same order as ObjectTracker::objects()).
+  struct PredictedPoses
+  {
+    std::chrono::high_resolution_clock::time_point stamp;
+    Eigen::ArrayXf x, y, z;
+    Eigen::ArrayXf qx, qy, qz, qw;
+    // 0 if the object was not tracked within the extrapolation bound
+    std::vector<uint8_t> valid;
+  };
+
+  // Extrapolates the tracked poses between frames at a fixed rate on a
+  // background thread, using the velocity and angular velocity of each
+  // object. publish() is called from ObjectTracker::update() and never
+  // blocks; input and output are handed over through lock-free triple
+  // buffers. Predictions are made in the time base of the frame stamps:
+  // the offset between the last frame stamp and the wall clock at
+  // publish() is kept, so playback at real time works as well.
+  class PosePredictor
+  {
+  public:
+    PosePredictor(double rate,
+      std::chrono::high_resolution_clock::duration maxExtrapolation = std::chrono::milliseconds(50));
+    ~PosePredictor();
+
+    void publish(std::chrono::high_resolution_clock::time_point stamp,
+      const std::vector<Object>& objects);
+
+    // Latest prediction. Call from a single consumer thread; the
+    // reference stays valid until the next call.
+    const PredictedPoses& poses();
+
+  private:
+    // motion state of all objects as of one frame
+    struct MotionState
+    {
+      // offset of the frame stamps to the wall clock
+      std::chrono::high_resolution_clock::duration clockOffset;
+      // seconds since clock epoch of the last valid pose
+      Eigen::ArrayXd stamp;
+      Eigen::ArrayXf x, y, z;
+      Eigen::ArrayXf qx, qy, qz, qw;
+      Eigen::ArrayXf vx, vy, vz;
+      Eigen::ArrayXf wx, wy, wz;
+      Eigen::Array<bool, Eigen::Dynamic, 1> valid;
+    };
+
+    void run();
+    void predict(const MotionState& state,
+      std::chrono::high_resolution_clock::time_point now,
+      PredictedPoses& poses);
+
+  private:
+    std::chrono::high_resolution_clock::duration m_period;
+    double m_maxExtrapolation;
+
+    TripleBuffer<MotionState> m_input;
+    TripleBuffer<PredictedPoses> m_output;
+
+    std::atomic<bool> m_running;
+    std::thread m_thread;
+  };
+
+} // namespace libobjecttracker
@@ -0,0 +1,75 @@
+#pragma once
+#include <cstddef>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+namespace libobjecttracker {
+
+  // number of markers removed by each stage; a marker is counted
+  // for the first stage that removes it
+  struct PreprocessingStatistics
+  {
+    uint64_t input;
+    uint64_t nonFinite;
+    uint64_t outsideWorkspace;
+    uint64_t belowFloor;
+    uint64_t merged;
+    uint64_t output;
+  };
+
+  // Cleans up a raw frame before tracking. The stages run in this order:
+  //   NaN/inf rejection (always),
+  //   workspace crop to an axis-aligned box,
+  //   clipping below a floor plane,
+  //   merging of markers closer than a distance (e.g. the same marker
+  //   seen by overlapping cameras) into their mean.
+  // The first three stages are evaluated for all markers at once as
+  // Eigen array expressions; only the merge needs a spatial hash.
+  class Preprocessor
+  {
+  public:
+    Preprocessor();
+
+    void setWorkspace(const Eigen::Vector3f& min, const Eigen::Vector3f& max);
+
+    // plane (a, b, c, d): markers with a*x + b*y + c*z + d < 0 are removed
+    void setFloorPlane(const Eigen::Vector4f& plane);
+
+    // 0 disables merging
+    void setMergeDistance(float distance);
+
+    // returns the input as is if no marker was removed
+    pcl::PointCloud<pcl::PointXYZ>::ConstPtr process(
+      pcl::PointCloud<pcl::PointXYZ>::ConstPtr cloud);
+
+    const PreprocessingStatistics& lastFrame() const { return m_lastFrame; }
+    const PreprocessingStatistics& total() const { return m_total; }
+
+  private:
+    uint64_t key(const Eigen::Vector3f& p, int dx, int dy, int dz) const;
+    size_t merge(pcl::PointCloud<pcl::PointXYZ>& cloud);
+
+  private:
+    bool m_hasWorkspace;
+    Eigen::Vector3f m_workspaceMin;
+    Eigen::Vector3f m_workspaceMax;
+    bool m_hasFloor;
+    Eigen::Vector4f m_floor;
+    float m_mergeDistance;
+
+    PreprocessingStatistics m_lastFrame;
+    PreprocessingStatistics m_total;
+
+    // scratch space for merging
+    std::unordered_map<uint64_t, int> m_cells;
+    std::vector<int> m_next;
+    std::vector<int> m_counts;
+  };
+
+} // namespace libobjecttracker
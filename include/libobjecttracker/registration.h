@@ -0,0 +1,112 @@
+#pragma once
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+namespace libobjecttracker {
+
+  // Weighting of correspondences by their residual r, recomputed in every
+  // iteration of RigidRegistration:
+  //   None:    least squares, all weights 1
+  //   Trimmed: only the best fraction (parameter, e.g. 0.75) of the
+  //            correspondences are used
+  //   Huber:   weight min(1, k / r), k = parameter (in m)
+  //   Tukey:   weight (1 - (r / c)^2)^2 for r < c, else 0; c = parameter
+  enum class RobustLoss { None, Trimmed, Huber, Tukey };
+
+  // Iterative closest point registration of a small model (the markers of
+  // one object) against a small target (the markers within the object's
+  // correspondence gate). Nearest neighbors are found by brute force, which
+  // is faster than a search tree at these sizes.
+  //
+  // Templated on the scalar type used for the computation and on the number
+  // of model markers (Eigen::Dynamic for any number), so the per-object
+  // kernels can use fixed-size matrices. Instantiations are provided for
+  // float and double with 4 or Eigen::Dynamic markers.
+  template <typename Scalar, int NumMarkers>
+  class RigidRegistration
+  {
+  public:
+    typedef Eigen::Matrix<Scalar, 3, 1> Vector;
+    typedef Eigen::Matrix<Scalar, 3, NumMarkers> ModelMatrix;
+    typedef Eigen::Matrix<Scalar, 1, NumMarkers> WeightVector;
+    typedef Eigen::Matrix<Scalar, 3, Eigen::Dynamic> TargetMatrix;
+    typedef Eigen::Transform<Scalar, 3, Eigen::Affine> Transform;
+
+    RigidRegistration();
+
+    // Closed-form weighted rigid fit (Kabsch): the transformation that maps
+    // src onto dst with minimal weighted squared error. Only the first
+    // n columns are used.
+    static Transform estimateRigidTransform(
+      const ModelMatrix& src,
+      const ModelMatrix& dst,
+      const WeightVector& weights,
+      int n);
+
+    void setModel(const pcl::PointCloud<pcl::PointXYZ>& model);
+    void setTarget(const pcl::PointCloud<pcl::PointXYZ>& target);
+    void setMaxCorrespondenceDistance(Scalar distance);
+    void setMaximumIterations(int iterations);
+    void setRobustLoss(RobustLoss loss, Scalar parameter);
+
+    // returns false if fewer than 3 correspondences were found
+    bool align(const Transform& guess);
+
+    const Transform& transformation() const { return m_transformation; }
+
+    // mean squared distance of the model markers to their nearest
+    // target marker at the final transformation
+    Scalar fitnessScore() const { return m_fitness; }
+
+    int iterations() const { return m_iterations; }
+
+    // at the final transformation, per model marker: index of the
+    // matched target marker (-1 if none within the correspondence
+    // distance) and squared distance to the nearest target marker
+    const Eigen::Matrix<int, 1, NumMarkers>& correspondences() const { return m_correspondences; }
+    const WeightVector& residuals() const { return m_residuals; }
+
+    // target marker j
+    Vector target(int j) const { return m_target.col(j); }
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  private:
+    int nearest(const Vector& p, Scalar& sqrDist) const;
+    // fills m_correspondences and m_residuals, returns the number of matches
+    int correspond(const Transform& transformation);
+    // fills m_src, m_dst and m_weights from the correspondences,
+    // returns the number of columns
+    int weighCorrespondences();
+
+  private:
+    ModelMatrix m_model;
+    TargetMatrix m_target;
+    Scalar m_maxCorrespondenceDistance;
+    int m_maxIterations;
+    RobustLoss m_loss;
+    Scalar m_lossParameter;
+
+    Transform m_transformation;
+    Scalar m_fitness;
+    int m_iterations;
+
+    // scratch space
+    ModelMatrix m_src;
+    ModelMatrix m_dst;
+    WeightVector m_weights;
+    Eigen::Matrix<int, 1, NumMarkers> m_correspondences;
+    WeightVector m_residuals;
+    WeightVector m_sorted;
+    WeightVector m_previousWeights;
+  };
+
+  extern template class RigidRegistration<float, 4>;
+  extern template class RigidRegistration<float, Eigen::Dynamic>;
+  extern template class RigidRegistration<double, 4>;
+  extern template class RigidRegistration<double, Eigen::Dynamic>;
+
+} // namespace libobjecttracker
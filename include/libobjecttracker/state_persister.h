@@ -0,0 +1,80 @@
+#pragma once
+#include <cstddef>
+#include <stdint.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace libobjecttracker {
+
+  class Object;
+
+  // compact tracking state of one object, as persisted to disk
+  struct ObjectState
+  {
+    uint32_t markerConfigurationIdx;
+    uint32_t dynamicsConfigurationIdx;
+    uint8_t valid;
+    int64_t stamp; // last valid pose, nanoseconds since the system_clock epoch
+    float position[3];
+    float orientation[4]; // quaternion x, y, z, w
+    float velocity[3];
+  };
+
+  // state file format (native endianness):
+  // magic "LOTS", version   : uint32, uint32
+  // number of objects       : uint32
+  // per object              : marker idx, dynamics idx : uint32 x 2
+  //                           valid                    : uint8
+  //                           stamp                    : int64
+  //                           position, orientation,
+  //                           velocity                 : float32 x 10
+
+  // returns false if the file does not exist or is malformed
+  bool readState(const std::string& path, std::vector<ObjectState>& states);
+
+  // writes to a temporary file first, so readers never see a partial
+  // state; returns false if the file could not be written
+  bool writeState(const std::string& path, const std::vector<ObjectState>& states);
+
+  // stamp is the tracker's current stamp and wallStamp the wall clock
+  // time it corresponds to; the object's stamp is converted with them
+  void captureState(const Object& object,
+    std::chrono::high_resolution_clock::time_point stamp,
+    std::chrono::system_clock::time_point wallStamp,
+    ObjectState& state);
+
+  // Periodically writes the tracker state to a file, so that a restarted
+  // tracker can continue from there (see ObjectTracker::restoreState).
+  // The file is written on a background thread; record() is called from
+  // ObjectTracker::update() and never blocks. The destructor waits for
+  // the last recorded state to be written.
+  class StatePersister
+  {
+  public:
+    StatePersister(const std::string& path, std::chrono::milliseconds period);
+    ~StatePersister();
+
+    void record(std::chrono::high_resolution_clock::time_point stamp,
+      const std::vector<Object>& objects);
+
+  private:
+    void run();
+
+  private:
+    std::string m_path;
+    std::chrono::high_resolution_clock::duration m_period;
+    std::chrono::high_resolution_clock::time_point m_lastRecord;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::vector<ObjectState> m_states;
+    bool m_pending;
+    bool m_running;
+    std::thread m_thread;
+  };
+
+} // namespace libobjecttracker
@@ -0,0 +1,52 @@
+#pragma once
+#include <atomic>
+#include <stdint.h>
+
+namespace libobjecttracker {
+
+  // Lock-free hand-over of the latest value from one writer thread to one
+  // reader thread. The writer fills back() and calls publish(); the reader
+  // calls update() and then reads front(). Neither side ever waits, and
+  // intermediate values the reader did not pick up are dropped.
+  template <typename T>
+  class TripleBuffer
+  {
+  public:
+    TripleBuffer()
+      : m_front(0)
+      , m_middle(1)
+      , m_back(2)
+    {
+    }
+
+    // writer side
+    T& back() { return m_buffers[m_back]; }
+
+    void publish()
+    {
+      m_back = m_middle.exchange(m_back | Fresh, std::memory_order_acq_rel) & Index;
+    }
+
+    // reader side; returns false if nothing new was published
+    bool update()
+    {
+      if (!(m_middle.load(std::memory_order_relaxed) & Fresh)) {
+        return false;
+      }
+      m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & Index;
+      return true;
+    }
+
+    const T& front() const { return m_buffers[m_front]; }
+
+  private:
+    static const uint8_t Index = 0x3;
+    static const uint8_t Fresh = 0x4;
+
+    T m_buffers[3];
+    uint8_t m_front;
+    std::atomic<uint8_t> m_middle;
+    uint8_t m_back;
+  };
+
+} // namespace libobjecttracker
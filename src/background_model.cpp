@@ -0,0 +1,111 @@
+#include "libobjecttracker/background_model.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace libobjecttracker {
+
+BackgroundModel::BackgroundModel(
+  float cellSize,
+  uint32_t learnFrames,
+  float exclusionMargin)
+  : m_cellSize(cellSize)
+  , m_learnFrames(std::max<uint32_t>(learnFrames, 1))
+  , m_exclusionMargin(exclusionMargin)
+  , m_frame(0)
+  , m_cells()
+  , m_background()
+{
+}
+
+uint64_t BackgroundModel::key(const pcl::PointXYZ& p) const
+{
+  // 21 bits per axis
+  uint64_t const mask = (1 << 21) - 1;
+  uint64_t const x = (int64_t)std::floor(p.x / m_cellSize) & mask;
+  uint64_t const y = (int64_t)std::floor(p.y / m_cellSize) & mask;
+  uint64_t const z = (int64_t)std::floor(p.z / m_cellSize) & mask;
+  return (x << 42) | (y << 21) | z;
+}
+
+bool BackgroundModel::excluded(const pcl::PointXYZ& p,
+  const std::vector<Eigen::Vector4f, Eigen::aligned_allocator<Eigen::Vector4f> >& exclusions) const
+{
+  Eigen::Vector3f const v(p.x, p.y, p.z);
+  for (auto const& e : exclusions) {
+    float const r = e.w() + m_exclusionMargin;
+    if ((e.head<3>() - v).squaredNorm() < r * r) {
+      return true;
+    }
+  }
+  return false;
+}
+
+pcl::PointCloud<pcl::PointXYZ>::ConstPtr BackgroundModel::filter(
+  pcl::PointCloud<pcl::PointXYZ>::ConstPtr markers,
+  const std::vector<Eigen::Vector4f, Eigen::aligned_allocator<Eigen::Vector4f> >& exclusions)
+{
+  ++m_frame;
+
+  // A cell gains 2 per frame it is seen in and loses 1 per frame it is
+  // not, so markers jittering across a cell border still build up.
+  // Decay is applied lazily when a cell is seen again. Markers near an
+  // object are neither removed nor learned, so a vehicle waiting at
+  // one spot does not turn into background once it leaves the sphere.
+  m_background.resize(markers->size());
+  size_t nBackground = 0;
+  for (size_t i = 0; i < markers->size(); ++i) {
+    if (excluded((*markers)[i], exclusions)) {
+      m_background[i] = false;
+      continue;
+    }
+    Cell& cell = m_cells.insert(std::make_pair(key((*markers)[i]), Cell{0, m_frame - 1})).first->second;
+    if (cell.lastFrame != m_frame) {
+      cell.score = std::max<int32_t>(0, cell.score - (int32_t)(m_frame - cell.lastFrame - 1));
+      cell.score = std::min(cell.score + 2, 2 * m_learnFrames);
+      cell.lastFrame = m_frame;
+    }
+    m_background[i] = cell.score >= m_learnFrames;
+    nBackground += m_background[i];
+  }
+
+  // forget cells that faded out
+  if (m_frame % m_learnFrames == 0) {
+    for (auto it = m_cells.begin(); it != m_cells.end();) {
+      if (m_frame - it->second.lastFrame >= (uint32_t)it->second.score) {
+        it = m_cells.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  if (nBackground == 0) {
+    return markers;
+  }
+  pcl::PointCloud<pcl::PointXYZ>::Ptr filtered(new pcl::PointCloud<pcl::PointXYZ>);
+  filtered->reserve(markers->size() - nBackground);
+  for (size_t i = 0; i < markers->size(); ++i) {
+    if (!m_background[i]) {
+      filtered->push_back((*markers)[i]);
+    }
+  }
+  return filtered;
+}
+
+size_t BackgroundModel::size() const
+{
+  size_t n = 0;
+  for (auto const& cell : m_cells) {
+    int32_t score = cell.second.score - (int32_t)(m_frame - cell.second.lastFrame);
+    n += score >= m_learnFrames;
+  }
+  return n;
+}
+
+void BackgroundModel::clear()
+{
+  m_cells.clear();
+}
+
+} // namespace libobjecttracker
@@ -0,0 +1,64 @@
+// Estimates a marker configuration from a cloud log of a vehicle being
+// moved around and prints it in the format read by playclouds. The
+// vehicle should start out level and facing +x; other markers in the
+// log have to stay further than 10cm away from it.
+//
+// usage: calibrate <cloud log> <number of markers> [name (default 0)]
+
+#include "libobjecttracker/calibration.h"
+#include "libobjecttracker/cloudlog.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+using namespace libobjecttracker;
+
+class CalibrationPlayer : public PointCloudPlayer
+{
+public:
+  size_t calibrate(MarkerCalibrator& calibrator) const
+  {
+    for (auto const &cloud : clouds) {
+      calibrator.addFrame(*cloud);
+    }
+    return clouds.size();
+  }
+};
+
+int main(int argc, char** argv)
+{
+  if (argc < 3) {
+    fprintf(stderr, "usage: %s <cloud log> <number of markers> [name]\n", argv[0]);
+    return 1;
+  }
+  std::string name = argc > 3 ? argv[3] : "0";
+
+  CalibrationPlayer player;
+  player.load(argv[1]);
+
+  MarkerCalibrator calibrator(atoi(argv[2]));
+  auto start = std::chrono::high_resolution_clock::now();
+  size_t frames = player.calibrate(calibrator);
+  pcl::PointCloud<pcl::PointXYZ> configuration;
+  float rms;
+  if (!calibrator.solve(configuration, rms)) {
+    fprintf(stderr, "none of the %zu frames contains the vehicle\n", frames);
+    return 1;
+  }
+  std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+  fprintf(stderr, "used %zu of %zu frames, rms %.2f mm, %.2f s\n",
+    calibrator.frames(), frames, rms * 1000, elapsed.count());
+
+  printf("markerConfigurations:\n");
+  printf("  \"%s\":\n", name.c_str());
+  printf("    numPoints: %zu\n", configuration.size());
+  printf("    offset: [0.0, 0.0, 0.0]\n");
+  printf("    points:\n");
+  for (size_t i = 0; i < configuration.size(); ++i) {
+    printf("      \"%zu\": [%.5f, %.5f, %.5f]\n", i,
+      configuration[i].x, configuration[i].y, configuration[i].z);
+  }
+  return 0;
+}
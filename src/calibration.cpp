@@ -0,0 +1,312 @@
+#include "libobjecttracker/calibration.h"
+#include "libobjecttracker/registration.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace libobjecttracker {
+
+typedef RigidRegistration<float, Eigen::Dynamic> Registration;
+
+static Eigen::MatrixXf pairwiseDistances(const Eigen::Matrix3Xf& points)
+{
+  int const n = points.cols();
+  Eigen::MatrixXf d(n, n);
+  for (int i = 0; i < n; ++i) {
+    for (int j = 0; j < n; ++j) {
+      d(i, j) = (points.col(i) - points.col(j)).norm();
+    }
+  }
+  return d;
+}
+
+MarkerCalibrator::MarkerCalibrator(size_t numMarkers,
+  float linkDistance,
+  float tolerance)
+  : m_numMarkers(numMarkers)
+  , m_linkDistance(linkDistance)
+  , m_tolerance(tolerance)
+  , m_referenceDistances()
+  , m_frames()
+{
+}
+
+bool MarkerCalibrator::cluster(const pcl::PointCloud<pcl::PointXYZ>& markers,
+  Eigen::Matrix3Xf& points) const
+{
+  // single-linkage clusters; frames hold few markers, so O(n^2) is fine
+  int const n = markers.size();
+  std::vector<int> parent(n);
+  std::iota(parent.begin(), parent.end(), 0);
+  auto find = [&parent](int i) {
+    while (parent[i] != i) {
+      parent[i] = parent[parent[i]];
+      i = parent[i];
+    }
+    return i;
+  };
+  float const maxSqrDist = m_linkDistance * m_linkDistance;
+  for (int i = 0; i < n; ++i) {
+    for (int j = i + 1; j < n; ++j) {
+      if ((markers[i].getVector3fMap() - markers[j].getVector3fMap()).squaredNorm() <= maxSqrDist) {
+        parent[find(j)] = find(i);
+      }
+    }
+  }
+
+  std::vector<int> size(n, 0);
+  for (int i = 0; i < n; ++i) {
+    ++size[find(i)];
+  }
+  int root = -1;
+  for (int i = 0; i < n; ++i) {
+    if (size[i] == (int)m_numMarkers) {
+      if (root >= 0) {
+        // ambiguous
+        return false;
+      }
+      root = i;
+    }
+  }
+  if (root < 0) {
+    return false;
+  }
+
+  points.resize(3, m_numMarkers);
+  int k = 0;
+  for (int i = 0; i < n; ++i) {
+    if (find(i) == root) {
+      points.col(k++) = markers[i].getVector3fMap();
+    }
+  }
+  return true;
+}
+
+// each column sorted ascending
+static Eigen::MatrixXf sortedColumns(Eigen::MatrixXf m)
+{
+  for (int i = 0; i < m.cols(); ++i) {
+    std::sort(m.col(i).data(), m.col(i).data() + m.rows());
+  }
+  return m;
+}
+
+float MarkerCalibrator::distanceError(const Eigen::Matrix3Xf& points) const
+{
+  return (pairwiseDistances(points) - m_referenceDistances).cwiseAbs().maxCoeff();
+}
+
+bool MarkerCalibrator::label(Eigen::Matrix3Xf& points) const
+{
+  int const n = m_numMarkers;
+  const Eigen::Matrix3Xf& previous = m_frames.back();
+
+  // follow each marker from the previous frame
+  std::vector<int> order(n);
+  std::vector<bool> used(n, false);
+  bool unique = true;
+  for (int i = 0; i < n; ++i) {
+    int best = 0;
+    (points.colwise() - previous.col(i)).colwise().squaredNorm().minCoeff(&best);
+    order[i] = best;
+    unique = unique && !used[best];
+    used[best] = true;
+  }
+  if (unique) {
+    Eigen::Matrix3Xf labeled(3, n);
+    for (int i = 0; i < n; ++i) {
+      labeled.col(i) = points.col(order[i]);
+    }
+    if (distanceError(labeled) <= m_tolerance) {
+      points = labeled;
+      return true;
+    }
+  }
+
+  // the vehicle jumped (e.g. after a gap in the log)
+  return n < 3 ? labelExhaustive(points) : labelByAnchors(points);
+}
+
+bool MarkerCalibrator::labelExhaustive(Eigen::Matrix3Xf& points) const
+{
+  // at most 2 orderings, see label
+  int const n = m_numMarkers;
+  std::vector<int> order(n);
+  std::iota(order.begin(), order.end(), 0);
+  float bestError = std::numeric_limits<float>::max();
+  Eigen::Matrix3Xf best;
+  Eigen::Matrix3Xf labeled(3, n);
+  do {
+    for (int i = 0; i < n; ++i) {
+      labeled.col(i) = points.col(order[i]);
+    }
+    float error = distanceError(labeled);
+    if (error < bestError) {
+      bestError = error;
+      best = labeled;
+    }
+  } while (std::next_permutation(order.begin(), order.end()));
+
+  if (bestError > m_tolerance) {
+    return false;
+  }
+  points = best;
+  return true;
+}
+
+bool MarkerCalibrator::labelByAnchors(Eigen::Matrix3Xf& points) const
+{
+  // Three reference markers spanning the largest triangle anchor the
+  // labeling: each frame marker triple with matching distances gives a
+  // pose, and the other markers are labeled by their nearest neighbor
+  // under it. Candidates for each anchor are pruned by comparing the
+  // sorted distances to all other markers, as in ConfigurationIndex, so
+  // the cost stays polynomial in n.
+  int const n = m_numMarkers;
+  const Eigen::Matrix3Xf& reference = m_frames.front();
+  Eigen::MatrixXf const frameDistances = pairwiseDistances(points);
+  Eigen::MatrixXf const referenceSignatures = sortedColumns(m_referenceDistances);
+  Eigen::MatrixXf const frameSignatures = sortedColumns(frameDistances);
+
+  int anchor[3] = {0, 1, 2};
+  float largestArea = -1;
+  for (int a = 0; a < n; ++a) {
+    for (int b = a + 1; b < n; ++b) {
+      for (int c = b + 1; c < n; ++c) {
+        Eigen::Vector3f const ab = reference.col(b) - reference.col(a);
+        Eigen::Vector3f const ac = reference.col(c) - reference.col(a);
+        float const area = ab.cross(ac).squaredNorm();
+        if (area > largestArea) {
+          largestArea = area;
+          anchor[0] = a;
+          anchor[1] = b;
+          anchor[2] = c;
+        }
+      }
+    }
+  }
+
+  // sorting does not increase the largest difference, so the right
+  // labeling is never pruned
+  std::vector<int> candidates[3];
+  for (int k = 0; k < 3; ++k) {
+    for (int i = 0; i < n; ++i) {
+      if ((frameSignatures.col(i) - referenceSignatures.col(anchor[k])).cwiseAbs().maxCoeff()
+          <= m_tolerance) {
+        candidates[k].push_back(i);
+      }
+    }
+  }
+
+  Registration::WeightVector const weights = Registration::WeightVector::Ones(3);
+  Eigen::Matrix3Xf src(3, 3);
+  for (int k = 0; k < 3; ++k) {
+    src.col(k) = reference.col(anchor[k]);
+  }
+  float bestError = std::numeric_limits<float>::max();
+  Eigen::Matrix3Xf best;
+  Eigen::Matrix3Xf dst(3, 3);
+  Eigen::Matrix3Xf labeled(3, n);
+  std::vector<bool> used(n);
+  for (int i : candidates[0]) {
+    for (int j : candidates[1]) {
+      if (j == i || std::abs(frameDistances(i, j)
+            - m_referenceDistances(anchor[0], anchor[1])) > m_tolerance) {
+        continue;
+      }
+      for (int k : candidates[2]) {
+        if (k == i || k == j
+            || std::abs(frameDistances(i, k) - m_referenceDistances(anchor[0], anchor[2])) > m_tolerance
+            || std::abs(frameDistances(j, k) - m_referenceDistances(anchor[1], anchor[2])) > m_tolerance) {
+          continue;
+        }
+        dst.col(0) = points.col(i);
+        dst.col(1) = points.col(j);
+        dst.col(2) = points.col(k);
+        Registration::Transform const t = Registration::estimateRigidTransform(src, dst, weights, 3);
+        std::fill(used.begin(), used.end(), false);
+        bool unique = true;
+        for (int m = 0; m < n && unique; ++m) {
+          int nearest = 0;
+          (points.colwise() - t * reference.col(m)).colwise().squaredNorm().minCoeff(&nearest);
+          unique = !used[nearest];
+          used[nearest] = true;
+          labeled.col(m) = points.col(nearest);
+        }
+        if (!unique) {
+          continue;
+        }
+        float const error = distanceError(labeled);
+        if (error < bestError) {
+          bestError = error;
+          best = labeled;
+        }
+      }
+    }
+  }
+
+  if (bestError > m_tolerance) {
+    return false;
+  }
+  points = best;
+  return true;
+}
+
+bool MarkerCalibrator::addFrame(const pcl::PointCloud<pcl::PointXYZ>& markers)
+{
+  Eigen::Matrix3Xf points;
+  if (!cluster(markers, points)) {
+    return false;
+  }
+  if (m_frames.empty()) {
+    m_referenceDistances = pairwiseDistances(points);
+  } else if (!label(points)) {
+    return false;
+  }
+  m_frames.push_back(points);
+  return true;
+}
+
+bool MarkerCalibrator::solve(pcl::PointCloud<pcl::PointXYZ>& configuration, float& rms) const
+{
+  if (m_frames.empty()) {
+    return false;
+  }
+  int const n = m_numMarkers;
+  Registration::WeightVector const weights = Registration::WeightVector::Ones(n);
+
+  // gauge: centroid at the origin, axes of the first frame
+  Eigen::Matrix3Xf const first = m_frames.front().colwise() - m_frames.front().rowwise().mean();
+  Eigen::Matrix3Xf shape = first;
+
+  Eigen::Matrix3Xf sum(3, n);
+  double sqrError = 0;
+  for (int iteration = 0; iteration < 20; ++iteration) {
+    sum.setZero();
+    sqrError = 0;
+    for (const auto& frame : m_frames) {
+      Registration::Transform t = Registration::estimateRigidTransform(frame, shape, weights, n);
+      Eigen::Matrix3Xf aligned = t * frame;
+      sqrError += (aligned - shape).squaredNorm();
+      sum += aligned;
+    }
+    Eigen::Matrix3Xf mean = sum / m_frames.size();
+    mean = Registration::estimateRigidTransform(mean, first, weights, n) * mean;
+    float const change = (mean - shape).norm();
+    shape = mean;
+    if (change < 1e-7) {
+      break;
+    }
+  }
+
+  configuration.clear();
+  for (int i = 0; i < n; ++i) {
+    configuration.push_back(pcl::PointXYZ(shape(0, i), shape(1, i), shape(2, i)));
+  }
+  rms = std::sqrt(sqrError / (m_frames.size() * n));
+  return true;
+}
+
+} // namespace libobjecttracker
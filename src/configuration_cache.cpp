@@ -0,0 +1,274 @@
+#include "libobjecttracker/configuration_cache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+
+// POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const uint32_t MAGIC = 0x43544f4c; // "LOTC"
+static const uint32_t VERSION = 3;
+// bytes per entry in the file, see configuration_cache.h
+static const size_t DYNAMICS_SIZE = 9 * 8 + 4;
+static const size_t POINT_SIZE = 3 * 4;
+static const size_t OBJECT_SIZE = 2 * 4 + 16 * 4;
+
+namespace {
+
+  // bounds-checked reads from the mapped file
+  class Reader
+  {
+  public:
+    Reader(const uint8_t* data, size_t size)
+      : m_data(data)
+      , m_size(size)
+      , m_pos(0)
+    {
+    }
+
+    template <typename T>
+    bool read(T& t)
+    {
+      return read(&t, 1);
+    }
+
+    template <typename T>
+    bool read(T* t, size_t n)
+    {
+      static_assert(std::is_trivially_copyable<T>::value, "expected POD");
+      if (n > (m_size - m_pos) / sizeof(T)) {
+        return false;
+      }
+      memcpy(t, m_data + m_pos, n * sizeof(T));
+      m_pos += n * sizeof(T);
+      return true;
+    }
+
+    // true if count entries of size bytes are left, checked before
+    // anything is allocated for them
+    bool holds(uint64_t count, size_t size) const
+    {
+      return count <= (m_size - m_pos) / size;
+    }
+
+    bool atEnd() const { return m_pos == m_size; }
+
+  private:
+    const uint8_t* m_data;
+    size_t m_size;
+    size_t m_pos;
+  };
+
+  template <typename T>
+  void write(std::ofstream &s, T const &t)
+  {
+    s.write((char const *)&t, sizeof(T));
+  }
+
+} // anonymous namespace
+
+namespace libobjecttracker {
+
+uint64_t configurationHash(const std::vector<std::string>& sources)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  for (const auto& source : sources) {
+    for (unsigned char c : source) {
+      hash ^= c;
+      hash *= 1099511628211ULL;
+    }
+    // separator, so that ("ab", "c") and ("a", "bc") differ
+    hash ^= 0xff;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+// the fields are written one by one, so no padding ends up in the file
+static bool readDynamics(Reader& r, DynamicsConfiguration& dyn)
+{
+  return r.read(dyn.maxXVelocity) && r.read(dyn.maxYVelocity) && r.read(dyn.maxZVelocity)
+    && r.read(dyn.maxPitchRate) && r.read(dyn.maxRollRate) && r.read(dyn.maxYawRate)
+    && r.read(dyn.maxRoll) && r.read(dyn.maxPitch) && r.read(dyn.maxFitnessScore)
+    && r.read(dyn.numParticles);
+}
+
+static void writeDynamics(std::ofstream& s, const DynamicsConfiguration& dyn)
+{
+  write(s, dyn.maxXVelocity);
+  write(s, dyn.maxYVelocity);
+  write(s, dyn.maxZVelocity);
+  write(s, dyn.maxPitchRate);
+  write(s, dyn.maxRollRate);
+  write(s, dyn.maxYawRate);
+  write(s, dyn.maxRoll);
+  write(s, dyn.maxPitch);
+  write(s, dyn.maxFitnessScore);
+  write(s, dyn.numParticles);
+}
+
+static bool decode(Reader& r,
+  uint64_t hash,
+  std::vector<DynamicsConfiguration>& dynamicsConfigurations,
+  std::vector<MarkerConfiguration>& markerConfigurations,
+  std::vector<Object>& objects)
+{
+  uint32_t magic, version;
+  uint64_t fileHash;
+  uint32_t nDyn, nMarkers, nObjects;
+  if (!r.read(magic) || magic != MAGIC
+      || !r.read(version) || version != VERSION
+      || !r.read(fileHash) || fileHash != hash
+      || !r.read(nDyn) || !r.read(nMarkers) || !r.read(nObjects)) {
+    return false;
+  }
+
+  // counts come from the file: each one is checked against the bytes
+  // left before allocating, so a corrupt cache cannot request more
+  // memory than its own size
+  if (!r.holds(nDyn, DYNAMICS_SIZE)) {
+    return false;
+  }
+  std::vector<DynamicsConfiguration> dyn(nDyn);
+  for (uint32_t i = 0; i < nDyn; ++i) {
+    if (!readDynamics(r, dyn[i])) {
+      return false;
+    }
+  }
+
+  if (!r.holds(nMarkers, sizeof(uint32_t))) {
+    return false;
+  }
+  std::vector<uint32_t> sizes(nMarkers);
+  if (!r.read(sizes.data(), nMarkers)) {
+    return false;
+  }
+  std::vector<MarkerConfiguration> markers;
+  markers.reserve(nMarkers);
+  for (uint32_t size : sizes) {
+    if (!r.holds(size, POINT_SIZE)) {
+      return false;
+    }
+    markers.push_back(MarkerConfiguration(new pcl::PointCloud<pcl::PointXYZ>));
+    markers.back()->resize(size);
+    for (auto &p : *markers.back()) {
+      float xyz[3];
+      if (!r.read(xyz, 3)) {
+        return false;
+      }
+      p = pcl::PointXYZ(xyz[0], xyz[1], xyz[2]);
+    }
+  }
+
+  if (!r.holds(nObjects, OBJECT_SIZE)) {
+    return false;
+  }
+  std::vector<Object> objs;
+  objs.reserve(nObjects);
+  for (uint32_t i = 0; i < nObjects; ++i) {
+    uint32_t markerIdx, dynIdx;
+    Eigen::Affine3f initial;
+    if (!r.read(markerIdx) || !r.read(dynIdx)
+        || !r.read(initial.matrix().data(), 16)
+        || markerIdx >= nMarkers || dynIdx >= nDyn) {
+      return false;
+    }
+    objs.emplace_back(markerIdx, dynIdx, initial);
+  }
+
+  if (!r.atEnd()) {
+    return false;
+  }
+
+  dynamicsConfigurations.swap(dyn);
+  markerConfigurations.swap(markers);
+  objects.swap(objs);
+  return true;
+}
+
+bool loadConfigurationCache(
+  const std::string& path,
+  uint64_t hash,
+  std::vector<DynamicsConfiguration>& dynamicsConfigurations,
+  std::vector<MarkerConfiguration>& markerConfigurations,
+  std::vector<Object>& objects)
+{
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return false;
+  }
+  void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+
+  Reader r((const uint8_t*)data, st.st_size);
+  bool ok = decode(r, hash, dynamicsConfigurations, markerConfigurations, objects);
+  munmap(data, st.st_size);
+  return ok;
+}
+
+void writeConfigurationCache(
+  const std::string& path,
+  uint64_t hash,
+  const std::vector<DynamicsConfiguration>& dynamicsConfigurations,
+  const std::vector<MarkerConfiguration>& markerConfigurations,
+  const std::vector<Object>& objects)
+{
+  // write to a temporary file first, so a concurrent reader
+  // never maps a partial cache
+  std::string tmp = path + ".tmp";
+  {
+    std::ofstream s(tmp, std::ios::binary | std::ios::out | std::ios::trunc);
+    if (!s) {
+      throw std::runtime_error("writeConfigurationCache: bad file path.");
+    }
+    write(s, MAGIC);
+    write(s, VERSION);
+    write(s, hash);
+    write(s, (uint32_t)dynamicsConfigurations.size());
+    write(s, (uint32_t)markerConfigurations.size());
+    write(s, (uint32_t)objects.size());
+    for (const auto& dyn : dynamicsConfigurations) {
+      writeDynamics(s, dyn);
+    }
+    for (const auto& config : markerConfigurations) {
+      write(s, (uint32_t)config->size());
+    }
+    for (const auto& config : markerConfigurations) {
+      for (pcl::PointXYZ const &p : *config) {
+        write(s, p.x);
+        write(s, p.y);
+        write(s, p.z);
+      }
+    }
+    for (const auto& object : objects) {
+      write(s, (uint32_t)object.markerConfigurationIdx());
+      write(s, (uint32_t)object.dynamicsConfigurationIdx());
+      const float* m = object.initialTransformation().matrix().data();
+      for (int i = 0; i < 16; ++i) {
+        write(s, m[i]);
+      }
+    }
+    if (!s) {
+      throw std::runtime_error("writeConfigurationCache: write failed.");
+    }
+  }
+  if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+    throw std::runtime_error("writeConfigurationCache: could not replace cache.");
+  }
+}
+
+} // namespace libobjecttracker
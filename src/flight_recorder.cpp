@@ -0,0 +1,209 @@
+#include "libobjecttracker/flight_recorder.h"
+#include "libobjecttracker/object_tracker.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+template <typename T>
+static void write(std::ofstream &s, T const &t)
+{
+  s.write((char const *)&t, sizeof(T));
+}
+
+namespace libobjecttracker {
+
+FlightRecorder::FlightRecorder(const std::string& pathPrefix,
+  size_t numFrames,
+  size_t maxMarkers)
+  : m_pathPrefix(pathPrefix)
+  , m_maxMarkers(maxMarkers)
+  , m_triggers(AllTriggers)
+  , m_latencyThreshold(0.02)
+  , m_postTriggerFrames(numFrames / 10)
+  , m_recording(&m_buffers[0])
+  , m_lastValid()
+  , m_countdown(-1)
+  , m_holdoff(0)
+  , m_writing(nullptr)
+  , m_nextIncident(0)
+  , m_incidents(0)
+  , m_droppedIncidents(0)
+  , m_running(true)
+{
+  for (auto& buffer : m_buffers) {
+    buffer.frames.resize(std::max<size_t>(numFrames, 1));
+    for (auto& frame : buffer.frames) {
+      frame.xyz.resize(3 * maxMarkers);
+    }
+    buffer.next = 0;
+    buffer.count = 0;
+  }
+  m_thread = std::thread(&FlightRecorder::run, this);
+}
+
+FlightRecorder::~FlightRecorder()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_running = false;
+  }
+  m_cv.notify_one();
+  m_thread.join();
+}
+
+void FlightRecorder::setTriggers(uint32_t triggers)
+{
+  m_triggers = triggers;
+}
+
+void FlightRecorder::setLatencyThreshold(double seconds)
+{
+  m_latencyThreshold = seconds;
+}
+
+void FlightRecorder::setPostTriggerFrames(size_t frames)
+{
+  m_postTriggerFrames = std::min(frames, m_buffers[0].frames.size() - 1);
+}
+
+void FlightRecorder::recordInput(std::chrono::high_resolution_clock::time_point stamp,
+  const pcl::PointCloud<pcl::PointXYZ>& markers,
+  const std::vector<Object>& objects)
+{
+  Frame& frame = m_recording->frames[m_recording->next];
+  frame.stamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    stamp.time_since_epoch()).count();
+  frame.numMarkers = std::min(markers.size(), m_maxMarkers);
+  for (size_t i = 0; i < frame.numMarkers; ++i) {
+    frame.xyz[3 * i + 0] = markers[i].x;
+    frame.xyz[3 * i + 1] = markers[i].y;
+    frame.xyz[3 * i + 2] = markers[i].z;
+  }
+  // only allocates if the number of objects grew; the states are kept
+  // on the tracker's clock, like the frame stamps (see writeIncident)
+  std::chrono::system_clock::time_point const wallStamp(
+    std::chrono::duration_cast<std::chrono::system_clock::duration>(stamp.time_since_epoch()));
+  frame.states.resize(objects.size());
+  for (size_t i = 0; i < objects.size(); ++i) {
+    captureState(objects[i], stamp, wallStamp, frame.states[i]);
+  }
+}
+
+void FlightRecorder::recordOutput(const std::vector<Object>& objects,
+  double latency,
+  bool initializationFailed)
+{
+  Buffer& buffer = *m_recording;
+  Frame& frame = buffer.frames[buffer.next];
+  frame.latency = latency;
+
+  uint32_t triggers = 0;
+  frame.validObjects = 0;
+  m_lastValid.resize(objects.size(), 0);
+  for (size_t i = 0; i < objects.size(); ++i) {
+    bool const valid = objects[i].active() && objects[i].lastTransformationValid();
+    if (m_lastValid[i] && !valid) {
+      triggers |= ObjectLost;
+    }
+    m_lastValid[i] = valid;
+    frame.validObjects += valid;
+  }
+  if (initializationFailed) {
+    triggers |= InitializationFailed;
+  }
+  if (latency > m_latencyThreshold) {
+    triggers |= LatencySpike;
+  }
+  frame.triggers = triggers & m_triggers;
+
+  buffer.next = (buffer.next + 1) % buffer.frames.size();
+  buffer.count = std::min(buffer.count + 1, buffer.frames.size());
+  if (m_holdoff > 0) {
+    --m_holdoff;
+  }
+
+  // record the frames after the trigger, then hand the buffer over
+  if (m_countdown > 0) {
+    --m_countdown;
+  } else if (m_countdown < 0 && frame.triggers != 0 && m_holdoff == 0) {
+    m_countdown = m_postTriggerFrames;
+  }
+  if (m_countdown != 0) {
+    return;
+  }
+  m_countdown = -1;
+  // at most one incident per buffer length, e.g. for repeated
+  // initialization failures
+  m_holdoff = buffer.frames.size();
+
+  std::unique_lock<std::mutex> lock(m_mutex, std::try_to_lock);
+  if (!lock.owns_lock() || m_writing) {
+    ++m_droppedIncidents;
+    return;
+  }
+  m_writing = m_recording;
+  m_recording = m_recording == &m_buffers[0] ? &m_buffers[1] : &m_buffers[0];
+  m_recording->next = 0;
+  m_recording->count = 0;
+  lock.unlock();
+  m_cv.notify_one();
+}
+
+void FlightRecorder::run()
+{
+  while (true) {
+    Buffer* buffer;
+    size_t incident;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cv.wait(lock, [this] { return m_writing || !m_running; });
+      if (!m_writing) {
+        return;
+      }
+      buffer = m_writing;
+      incident = m_nextIncident++;
+    }
+
+    // the tracker does not touch the buffer until it is released
+    writeIncident(*buffer, incident);
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_writing = nullptr;
+    }
+    ++m_incidents;
+  }
+}
+
+void FlightRecorder::writeIncident(Buffer& buffer, size_t incident)
+{
+  std::stringstream sstr;
+  sstr << m_pathPrefix << incident;
+  std::string const path = sstr.str();
+
+  size_t const n = buffer.frames.size();
+  size_t const first = (buffer.next + n - buffer.count) % n;
+  int64_t const start = buffer.frames[first].stamp;
+
+  std::ofstream log(path + ".log", std::ios::binary | std::ios::out | std::ios::trunc);
+  std::ofstream csv(path + ".csv", std::ios::out | std::ios::trunc);
+  csv << "frame,millis,latency_ms,markers,valid_objects,triggers\n";
+  for (size_t k = 0; k < buffer.count; ++k) {
+    const Frame& frame = buffer.frames[(first + k) % n];
+    uint32_t const millis = (frame.stamp - start) / 1000000;
+    write(log, millis);
+    write(log, frame.numMarkers);
+    log.write((char const *)frame.xyz.data(), 3 * frame.numMarkers * sizeof(float));
+    csv << k << "," << millis << "," << frame.latency * 1000 << ","
+        << frame.numMarkers << "," << frame.validObjects << "," << frame.triggers << "\n";
+  }
+  // the log starts at 0ms, so the state is rebased onto that origin
+  // (the buffer is rewritten by recordInput once it is reused)
+  for (auto& state : buffer.frames[first].states) {
+    state.stamp -= start;
+  }
+  writeState(path + ".state", buffer.frames[first].states);
+}
+
+} // namespace libobjecttracker
@@ -0,0 +1,257 @@
+#include "libobjecttracker/identification.h"
+#include "libobjecttracker/registration.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <unordered_map>
+
+namespace libobjecttracker {
+
+static Eigen::Matrix3Xf toMatrix(const pcl::PointCloud<pcl::PointXYZ>& cloud)
+{
+  Eigen::Matrix3Xf points(3, cloud.size());
+  for (size_t i = 0; i < cloud.size(); ++i) {
+    points.col(i) = cloud[i].getVector3fMap();
+  }
+  return points;
+}
+
+Eigen::VectorXf ConfigurationIndex::signature(const Eigen::Matrix3Xf& points)
+{
+  int const n = points.cols();
+  Eigen::VectorXf result(n * (n - 1) / 2);
+  int k = 0;
+  for (int i = 0; i < n; ++i) {
+    for (int j = i + 1; j < n; ++j) {
+      result(k++) = (points.col(i) - points.col(j)).norm();
+    }
+  }
+  std::sort(result.data(), result.data() + result.size());
+  return result;
+}
+
+Eigen::MatrixXf ConfigurationIndex::markerSignatures(const Eigen::Matrix3Xf& points)
+{
+  int const n = points.cols();
+  Eigen::MatrixXf result(n - 1, n);
+  for (int i = 0; i < n; ++i) {
+    int k = 0;
+    for (int j = 0; j < n; ++j) {
+      if (j != i) {
+        result(k++, i) = (points.col(i) - points.col(j)).norm();
+      }
+    }
+    std::sort(result.col(i).data(), result.col(i).data() + n - 1);
+  }
+  return result;
+}
+
+ConfigurationIndex::ConfigurationIndex(
+  const std::vector<pcl::PointCloud<pcl::PointXYZ>::Ptr>& markerConfigurations,
+  float tolerance)
+  : m_tolerance(tolerance)
+  , m_linkDistance(0)
+  , m_descriptors()
+{
+  for (size_t c = 0; c < markerConfigurations.size(); ++c) {
+    Descriptor d;
+    d.markerConfigurationIdx = c;
+    d.points = toMatrix(*markerConfigurations[c]);
+    if (d.points.cols() < 3) {
+      // a pose needs at least 3 markers
+      continue;
+    }
+    d.signature = signature(d.points);
+    d.diameter = d.signature.maxCoeff();
+    d.markerSignatures = markerSignatures(d.points);
+    // the first row holds each marker's nearest neighbor distance
+    m_linkDistance = std::max(m_linkDistance, d.markerSignatures.row(0).maxCoeff());
+    m_descriptors.push_back(d);
+  }
+  m_linkDistance += tolerance;
+
+  std::sort(m_descriptors.begin(), m_descriptors.end(),
+    [](const Descriptor& a, const Descriptor& b) {
+      return a.points.cols() != b.points.cols()
+        ? a.points.cols() < b.points.cols()
+        : a.diameter < b.diameter;
+    });
+}
+
+void ConfigurationIndex::clusters(const pcl::PointCloud<pcl::PointXYZ>& markers,
+  std::vector<std::vector<int> >& result) const
+{
+  // union-find over markers closer than the link distance, with
+  // neighbors found through a spatial hash of link-distance cells
+  int const n = markers.size();
+  std::vector<int> parent(n);
+  std::iota(parent.begin(), parent.end(), 0);
+  auto find = [&parent](int i) {
+    while (parent[i] != i) {
+      parent[i] = parent[parent[i]];
+      i = parent[i];
+    }
+    return i;
+  };
+
+  auto cell = [this](const Eigen::Vector3f& p, int dx, int dy, int dz) {
+    uint64_t const mask = (1 << 21) - 1;
+    uint64_t const x = ((int64_t)std::floor(p.x() / m_linkDistance) + dx) & mask;
+    uint64_t const y = ((int64_t)std::floor(p.y() / m_linkDistance) + dy) & mask;
+    uint64_t const z = ((int64_t)std::floor(p.z() / m_linkDistance) + dz) & mask;
+    return (x << 42) | (y << 21) | z;
+  };
+  std::unordered_multimap<uint64_t, int> cells;
+  for (int i = 0; i < n; ++i) {
+    cells.insert(std::make_pair(cell(markers[i].getVector3fMap(), 0, 0, 0), i));
+  }
+
+  float const maxSqrDist = m_linkDistance * m_linkDistance;
+  for (int i = 0; i < n; ++i) {
+    Eigen::Vector3f const p = markers[i].getVector3fMap();
+    for (int dx = -1; dx <= 1; ++dx) {
+      for (int dy = -1; dy <= 1; ++dy) {
+        for (int dz = -1; dz <= 1; ++dz) {
+          auto range = cells.equal_range(cell(p, dx, dy, dz));
+          for (auto it = range.first; it != range.second; ++it) {
+            int const j = it->second;
+            if (j > i && (markers[j].getVector3fMap() - p).squaredNorm() <= maxSqrDist) {
+              parent[find(j)] = find(i);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  std::unordered_map<int, size_t> clusterOf;
+  result.clear();
+  for (int i = 0; i < n; ++i) {
+    auto inserted = clusterOf.insert(std::make_pair(find(i), result.size()));
+    if (inserted.second) {
+      result.push_back(std::vector<int>());
+    }
+    result[inserted.first->second].push_back(i);
+  }
+}
+
+bool ConfigurationIndex::solvePose(const Descriptor& descriptor,
+  const Eigen::Matrix3Xf& cluster,
+  Eigen::Affine3f& transformation,
+  float& fitness) const
+{
+  typedef RigidRegistration<float, Eigen::Dynamic> Registration;
+  int const n = cluster.cols();
+  Eigen::MatrixXf const clusterSignatures = markerSignatures(cluster);
+
+  // model markers each cluster marker could be, by per-marker descriptor
+  std::vector<std::vector<int> > candidates(n);
+  for (int a = 0; a < n; ++a) {
+    for (int i = 0; i < n; ++i) {
+      float diff = (clusterSignatures.col(a) - descriptor.markerSignatures.col(i)).cwiseAbs().maxCoeff();
+      if (diff <= m_tolerance) {
+        candidates[a].push_back(i);
+      }
+    }
+    if (candidates[a].empty()) {
+      return false;
+    }
+  }
+
+  // Depth-first search over consistent assignments; symmetric
+  // configurations have several, the best fit wins.
+  static int const MaxAssignments = 256;
+  int assignments = 0;
+  fitness = std::numeric_limits<float>::max();
+  std::vector<int> assignment(n);
+  std::vector<bool> used(n, false);
+  Registration::WeightVector const weights = Registration::WeightVector::Ones(n);
+  Registration::ModelMatrix src(3, n);
+
+  std::function<void(int)> search = [&](int a) {
+    if (assignments >= MaxAssignments) {
+      return;
+    }
+    if (a == n) {
+      ++assignments;
+      for (int k = 0; k < n; ++k) {
+        src.col(k) = descriptor.points.col(assignment[k]);
+      }
+      Registration::Transform t = Registration::estimateRigidTransform(src, cluster, weights, n);
+      float error = ((t * src) - cluster).colwise().squaredNorm().mean();
+      if (error < fitness) {
+        fitness = error;
+        transformation = t;
+      }
+      return;
+    }
+    for (int i : candidates[a]) {
+      if (!used[i]) {
+        used[i] = true;
+        assignment[a] = i;
+        search(a + 1);
+        used[i] = false;
+      }
+    }
+  };
+  search(0);
+
+  return fitness <= m_tolerance * m_tolerance;
+}
+
+std::vector<Identification, Eigen::aligned_allocator<Identification> > ConfigurationIndex::identify(
+  const pcl::PointCloud<pcl::PointXYZ>& markers) const
+{
+  std::vector<Identification, Eigen::aligned_allocator<Identification> > result;
+  std::vector<std::vector<int> > clusterIndices;
+  clusters(markers, clusterIndices);
+
+  for (const auto& indices : clusterIndices) {
+    int const n = indices.size();
+    if (n < 3) {
+      continue;
+    }
+    Eigen::Matrix3Xf cluster(3, n);
+    for (int k = 0; k < n; ++k) {
+      cluster.col(k) = markers[indices[k]].getVector3fMap();
+    }
+    Eigen::VectorXf const clusterSignature = signature(cluster);
+    float const diameter = clusterSignature.maxCoeff();
+
+    // configurations with the same number of markers and a similar diameter
+    auto it = std::lower_bound(m_descriptors.begin(), m_descriptors.end(),
+      std::make_pair(n, diameter - m_tolerance),
+      [](const Descriptor& d, const std::pair<int, float>& key) {
+        return d.points.cols() != key.first
+          ? d.points.cols() < key.first
+          : d.diameter < key.second;
+      });
+
+    Identification best;
+    best.fitness = std::numeric_limits<float>::max();
+    for (; it != m_descriptors.end()
+           && it->points.cols() == n
+           && it->diameter <= diameter + m_tolerance; ++it) {
+      if ((it->signature - clusterSignature).cwiseAbs().maxCoeff() > m_tolerance) {
+        continue;
+      }
+      Eigen::Affine3f transformation;
+      float fitness;
+      if (solvePose(*it, cluster, transformation, fitness) && fitness < best.fitness) {
+        best.markerConfigurationIdx = it->markerConfigurationIdx;
+        best.transformation = transformation;
+        best.fitness = fitness;
+      }
+    }
+    if (best.fitness < std::numeric_limits<float>::max()) {
+      best.markers = indices;
+      result.push_back(best);
+    }
+  }
+  return result;
+}
+
+} // namespace libobjecttracker
@@ -5,7 +5,7 @@ else
 CC="g++"
 fi
 
-CFLAGS="-g -Wall -std=c++11"
+CFLAGS="-g -Wall -std=c++11 -pthread"
 
 if [ `uname` = "Darwin" ]; then
 LIBS="-I../include/ \
@@ -23,7 +23,7 @@ LIBS="-I../include/ \
 -I/usr/include/yaml-cpp"
 fi
 
-$CC $CFLAGS $LIBS playclouds.cpp object_tracker.cpp \
+$CC $CFLAGS $LIBS playclouds.cpp object_tracker.cpp metrics_exporter.cpp state_persister.cpp registration.cpp pose_history.cpp pose_predictor.cpp background_model.cpp preprocessor.cpp identification.cpp calibration.cpp particle_filter.cpp flight_recorder.cpp configuration_cache.cpp \
 -lpcl_registration -lpcl_features -lpcl_filters -lpcl_sample_consensus \
 -lpcl_search -lpcl_kdtree -lflann_cpp -lpcl_octree -lpcl_common \
 -lyaml-cpp
@@ -0,0 +1,24 @@
+#!/bin/sh
+if [ `uname` = 'Darwin' ]; then
+CC="clang++"
+else
+CC="g++"
+fi
+
+CFLAGS="-O2 -Wall -std=c++11 -pthread"
+
+if [ `uname` = "Darwin" ]; then
+LIBS="-I../include/ \
+-I/usr/local/Cellar/pcl/1.7.2/include/pcl-1.7 \
+-I/usr/local/Cellar/eigen/3.2.2/include/eigen3 \
+-L/usr/local/Cellar/pcl/1.7.2/lib \
+-L/usr/local/Cellar/flann/1.8.4/lib"
+else
+LIBS="-I../include/ \
+-I/usr/include/pcl-1.7 \
+-I/usr/include/eigen3"
+fi
+
+$CC $CFLAGS $LIBS -o scaling scaling.cpp object_tracker.cpp metrics_exporter.cpp state_persister.cpp registration.cpp pose_history.cpp pose_predictor.cpp background_model.cpp preprocessor.cpp identification.cpp calibration.cpp particle_filter.cpp flight_recorder.cpp \
+-lpcl_registration -lpcl_features -lpcl_filters -lpcl_sample_consensus \
+-lpcl_search -lpcl_kdtree -lflann_cpp -lpcl_octree -lpcl_common
@@ -0,0 +1,271 @@
+#include "libobjecttracker/metrics_exporter.h"
+#include "libobjecttracker/object_tracker.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+// POSIX
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace libobjecttracker {
+
+const size_t MetricsExporter::Window;
+
+MetricsExporter::MetricsExporter()
+  : m_frames(0)
+  , m_initializations(0)
+  , m_initializationFailures(0)
+  , m_warnings(0)
+  , m_objectsLost(0)
+  , m_running(false)
+  , m_listenFd(-1)
+  , m_path()
+  , m_period(0)
+{
+  for (size_t i = 0; i < Window; ++i) {
+    m_latencies[i] = 0;
+    m_stamps[i] = 0;
+  }
+}
+
+MetricsExporter::~MetricsExporter()
+{
+  stop();
+  if (m_listenFd >= 0) {
+    close(m_listenFd);
+  }
+}
+
+void MetricsExporter::serve(uint16_t port)
+{
+  stop();
+
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    throw std::runtime_error("MetricsExporter: could not create socket.");
+  }
+  int yes = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 4) != 0) {
+    close(fd);
+    throw std::runtime_error("MetricsExporter: could not bind to port.");
+  }
+
+  if (m_listenFd >= 0) {
+    close(m_listenFd);
+  }
+  m_listenFd = fd;
+  start();
+}
+
+void MetricsExporter::writeFile(const std::string& path, std::chrono::milliseconds period)
+{
+  stop();
+  m_path = path;
+  m_period = period;
+  start();
+}
+
+void MetricsExporter::stop()
+{
+  m_running = false;
+  if (m_thread.joinable()) {
+    m_thread.join();
+  }
+}
+
+void MetricsExporter::recordFrame(std::chrono::high_resolution_clock::time_point stamp,
+  double latency,
+  const std::vector<Object>& objects)
+{
+  uint64_t frame = m_frames.load(std::memory_order_relaxed);
+  size_t slot = frame % Window;
+  m_latencies[slot].store(latency, std::memory_order_relaxed);
+  m_stamps[slot].store(std::chrono::duration_cast<std::chrono::nanoseconds>(
+    stamp.time_since_epoch()).count(), std::memory_order_relaxed);
+  m_frames.store(frame + 1, std::memory_order_release);
+
+  m_lastValid.resize(objects.size(), 0);
+  for (size_t i = 0; i < objects.size(); ++i) {
+    uint8_t valid = objects[i].lastTransformationValid();
+    if (m_lastValid[i] && !valid) {
+      ++m_objectsLost;
+    }
+    m_lastValid[i] = valid;
+  }
+
+  // if the exporter is reading right now, skip this frame's snapshot;
+  // the next frame will refresh it
+  std::unique_lock<std::mutex> lock(m_validMutex, std::try_to_lock);
+  if (lock.owns_lock()) {
+    m_valid = m_lastValid;
+  }
+}
+
+void MetricsExporter::recordInitialization(bool success)
+{
+  ++m_initializations;
+  if (!success) {
+    ++m_initializationFailures;
+  }
+}
+
+void MetricsExporter::recordWarning()
+{
+  ++m_warnings;
+}
+
+std::string MetricsExporter::render()
+{
+  uint64_t frames = m_frames.load(std::memory_order_acquire);
+  size_t n = std::min<uint64_t>(frames, Window);
+
+  std::vector<float> latencies(n);
+  int64_t newest = 0;
+  int64_t oldest = 0;
+  for (size_t i = 0; i < n; ++i) {
+    size_t slot = (frames - n + i) % Window;
+    latencies[i] = m_latencies[slot].load(std::memory_order_relaxed);
+    int64_t stamp = m_stamps[slot].load(std::memory_order_relaxed);
+    if (i == 0) {
+      oldest = stamp;
+    }
+    newest = stamp;
+  }
+  std::sort(latencies.begin(), latencies.end());
+
+  double frameRate = 0;
+  if (n > 1 && newest > oldest) {
+    frameRate = (n - 1) / ((newest - oldest) * 1e-9);
+  }
+
+  std::vector<uint8_t> valid;
+  {
+    std::lock_guard<std::mutex> lock(m_validMutex);
+    valid = m_valid;
+  }
+  size_t nValid = std::count(valid.begin(), valid.end(), 1);
+
+  std::stringstream sstr;
+  sstr << "# TYPE libobjecttracker_frames_total counter\n"
+       << "libobjecttracker_frames_total " << frames << "\n"
+       << "# TYPE libobjecttracker_frame_rate_hz gauge\n"
+       << "libobjecttracker_frame_rate_hz " << frameRate << "\n"
+       << "# TYPE libobjecttracker_update_latency_seconds summary\n";
+  static const double quantiles[] = {0.5, 0.9, 0.99, 1.0};
+  for (double q : quantiles) {
+    float value = 0;
+    if (n > 0) {
+      value = latencies[std::min<size_t>(q * n, n - 1)];
+    }
+    sstr << "libobjecttracker_update_latency_seconds{quantile=\"" << q << "\"} "
+         << value << "\n";
+  }
+  sstr << "# TYPE libobjecttracker_object_valid gauge\n";
+  for (size_t i = 0; i < valid.size(); ++i) {
+    sstr << "libobjecttracker_object_valid{object=\"" << i << "\"} "
+         << (int)valid[i] << "\n";
+  }
+  sstr << "# TYPE libobjecttracker_objects_invalid gauge\n"
+       << "libobjecttracker_objects_invalid " << valid.size() - nValid << "\n"
+       << "# TYPE libobjecttracker_objects_lost_total counter\n"
+       << "libobjecttracker_objects_lost_total " << m_objectsLost << "\n"
+       << "# TYPE libobjecttracker_initializations_total counter\n"
+       << "libobjecttracker_initializations_total " << m_initializations << "\n"
+       << "# TYPE libobjecttracker_initialization_failures_total counter\n"
+       << "libobjecttracker_initialization_failures_total " << m_initializationFailures << "\n"
+       << "# TYPE libobjecttracker_warnings_total counter\n"
+       << "libobjecttracker_warnings_total " << m_warnings << "\n";
+  return sstr.str();
+}
+
+void MetricsExporter::start()
+{
+  m_running = true;
+  m_thread = std::thread(&MetricsExporter::run, this);
+}
+
+void MetricsExporter::run()
+{
+  // wake up often enough to notice stop() and to honor the file period
+  int timeout = 100;
+  if (!m_path.empty()) {
+    timeout = std::max<int>(1, std::min<int>(timeout, m_period.count()));
+  }
+  auto nextWrite = std::chrono::steady_clock::now();
+
+  while (m_running) {
+    if (m_listenFd >= 0) {
+      pollfd pfd = {m_listenFd, POLLIN, 0};
+      if (poll(&pfd, 1, timeout) > 0 && (pfd.revents & POLLIN)) {
+        int client = accept(m_listenFd, nullptr, nullptr);
+        if (client >= 0) {
+          serveClient(client);
+          close(client);
+        }
+      }
+    } else {
+      std::this_thread::sleep_for(std::chrono::milliseconds(timeout));
+    }
+
+    if (!m_path.empty() && std::chrono::steady_clock::now() >= nextWrite) {
+      writeFileNow();
+      nextWrite += m_period;
+    }
+  }
+}
+
+void MetricsExporter::serveClient(int fd)
+{
+  // we answer every request with the metrics page, so the request
+  // itself only needs to be drained
+  char buf[1024];
+  pollfd pfd = {fd, POLLIN, 0};
+  if (poll(&pfd, 1, 100) > 0) {
+    if (read(fd, buf, sizeof(buf)) < 0) {
+      return;
+    }
+  }
+
+  std::string body = render();
+  std::stringstream sstr;
+  sstr << "HTTP/1.0 200 OK\r\n"
+       << "Content-Type: text/plain; version=0.0.4\r\n"
+       << "Content-Length: " << body.size() << "\r\n"
+       << "Connection: close\r\n\r\n"
+       << body;
+  std::string response = sstr.str();
+  size_t written = 0;
+  while (written < response.size()) {
+    ssize_t w = send(fd, response.data() + written, response.size() - written, MSG_NOSIGNAL);
+    if (w <= 0) {
+      break;
+    }
+    written += w;
+  }
+}
+
+void MetricsExporter::writeFileNow()
+{
+  // write to a temporary file first, so readers never see a partial file
+  std::string tmp = m_path + ".tmp";
+  {
+    std::ofstream s(tmp, std::ios::out | std::ios::trunc);
+    s << render();
+  }
+  std::rename(tmp.c_str(), m_path.c_str());
+}
+
+} // namespace libobjecttracker
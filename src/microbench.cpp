@@ -0,0 +1,346 @@
+// Microbenchmarks for the building blocks of the tracker, at realistic
+// sizes (4-16 model points, 10-5000 frame markers):
+//   - correspondence search: kd-tree vs. brute force vs. uniform grid
+//   - rigid solve, registration and fitness evaluation, with the
+//     RigidRegistration kernels the tracker uses (<float, 4> for
+//     4-marker objects, <float, N> otherwise) and <double, N>
+//   - Euler / quaternion conversions
+//   - dynamics check
+//   - cloud log decode
+//
+// usage: microbench [kernel name filter]
+
+#include "libobjecttracker/object_tracker.h"
+#include "libobjecttracker/cloudlog.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <string>
+#include <unordered_map>
+
+#include <pcl/common/transforms.h>
+#include <pcl/kdtree/kdtree_flann.h>
+
+using namespace libobjecttracker;
+
+static std::string filter;
+static volatile float sink;
+
+// run f repeatedly for at least 50ms and print the time per call
+static void bench(const std::string& name, size_t modelPts, size_t markers,
+  std::function<void()> f)
+{
+  if (!filter.empty() && name.find(filter) == std::string::npos) {
+    return;
+  }
+  f();
+  size_t reps = 0;
+  auto start = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double> elapsed(0);
+  for (size_t batch = 1; elapsed.count() < 0.05; batch *= 2) {
+    for (size_t i = 0; i < batch; ++i) {
+      f();
+    }
+    reps += batch;
+    elapsed = std::chrono::high_resolution_clock::now() - start;
+  }
+  printf("%-24s %6zu %8zu %14.1f\n", name.c_str(), modelPts, markers,
+    1e9 * elapsed.count() / reps);
+}
+
+static std::default_random_engine eng(42);
+
+// model with n markers within a 5cm radius
+static Cloud::Ptr makeModel(size_t n)
+{
+  std::uniform_real_distribution<float> u(-0.05, 0.05);
+  Cloud::Ptr cloud(new Cloud);
+  for (size_t i = 0; i < n; ++i) {
+    cloud->push_back(Point(u(eng), u(eng), u(eng)));
+  }
+  return cloud;
+}
+
+// frame with the model at pose plus (n - model size) clutter markers
+// spread over a 10m x 10m x 3m arena
+static Cloud::Ptr makeFrame(const Cloud& model, const Eigen::Affine3f& pose, size_t n)
+{
+  std::uniform_real_distribution<float> xy(-5, 5);
+  std::uniform_real_distribution<float> z(0, 3);
+  Cloud::Ptr cloud(new Cloud);
+  for (auto const &p : model) {
+    Eigen::Vector3f v = pose * Eigen::Vector3f(p.x, p.y, p.z);
+    cloud->push_back(Point(v.x(), v.y(), v.z()));
+  }
+  while (cloud->size() < n) {
+    cloud->push_back(Point(xy(eng), xy(eng), z(eng)));
+  }
+  return cloud;
+}
+
+// uniform grid hashing points into cubic cells of the search radius,
+// so a radius query only needs to visit the 27 neighboring cells
+class Grid
+{
+public:
+  Grid(const Cloud& cloud, float cellSize)
+    : m_cloud(cloud)
+    , m_cellSize(cellSize)
+  {
+    for (size_t i = 0; i < cloud.size(); ++i) {
+      m_cells[key(cell(cloud[i].x), cell(cloud[i].y), cell(cloud[i].z))].push_back(i);
+    }
+  }
+
+  int nearest(const Point& q) const
+  {
+    int best = -1;
+    float bestDist = m_cellSize * m_cellSize;
+    int cx = cell(q.x), cy = cell(q.y), cz = cell(q.z);
+    for (int dx = -1; dx <= 1; ++dx) {
+      for (int dy = -1; dy <= 1; ++dy) {
+        for (int dz = -1; dz <= 1; ++dz) {
+          auto it = m_cells.find(key(cx + dx, cy + dy, cz + dz));
+          if (it == m_cells.end()) {
+            continue;
+          }
+          for (int idx : it->second) {
+            float d = (m_cloud[idx].getVector3fMap() - q.getVector3fMap()).squaredNorm();
+            if (d < bestDist) {
+              bestDist = d;
+              best = idx;
+            }
+          }
+        }
+      }
+    }
+    return best;
+  }
+
+  size_t cells() const { return m_cells.size(); }
+
+private:
+  int cell(float v) const { return (int)std::floor(v / m_cellSize); }
+  static int64_t key(int64_t x, int64_t y, int64_t z)
+  {
+    return (x & 0x1fffff) | ((y & 0x1fffff) << 21) | ((z & 0x1fffff) << 42);
+  }
+
+  const Cloud& m_cloud;
+  float m_cellSize;
+  std::unordered_map<int64_t, std::vector<int> > m_cells;
+};
+
+static void benchCorrespondences(size_t modelPts, size_t markers)
+{
+  Cloud::Ptr model = makeModel(modelPts);
+  Eigen::Affine3f pose = pcl::getTransformation(1, 2, 1, 0, 0, 0.3);
+  Cloud::Ptr frame = makeFrame(*model, pose, markers);
+  Cloud predicted;
+  pcl::transformPointCloud(*model, predicted, pose);
+
+  pcl::KdTreeFLANN<Point> kdtree;
+  std::vector<int> idx(1);
+  std::vector<float> dist(1);
+  bench("kdtree build", modelPts, markers, [&]() {
+    kdtree.setInputCloud(frame);
+  });
+  kdtree.setInputCloud(frame);
+  bench("kdtree query", modelPts, markers, [&]() {
+    for (auto const &p : predicted) {
+      kdtree.nearestKSearch(p, 1, idx, dist);
+      sink = dist[0];
+    }
+  });
+
+  bench("bruteforce query", modelPts, markers, [&]() {
+    for (auto const &p : predicted) {
+      float best = FLT_MAX;
+      for (auto const &q : *frame) {
+        best = std::min(best, (p.getVector3fMap() - q.getVector3fMap()).squaredNorm());
+      }
+      sink = best;
+    }
+  });
+
+  bench("grid build", modelPts, markers, [&]() {
+    Grid grid(*frame, 0.05);
+    sink = grid.cells();
+  });
+  Grid grid(*frame, 0.05);
+  bench("grid query", modelPts, markers, [&]() {
+    for (auto const &p : predicted) {
+      sink = grid.nearest(p);
+    }
+  });
+}
+
+template <typename Scalar, int NumMarkers>
+static void benchRigidSolve(const std::string& kernel, size_t modelPts)
+{
+  typedef RigidRegistration<Scalar, NumMarkers> Registration;
+  Cloud::Ptr model = makeModel(modelPts);
+  Eigen::Affine3f pose = pcl::getTransformation(0.01, 0.02, 0, 0.01, 0.02, 0.1);
+  typename Registration::ModelMatrix src(3, modelPts);
+  typename Registration::ModelMatrix dst(3, modelPts);
+  typename Registration::WeightVector weights(modelPts);
+  for (size_t i = 0; i < modelPts; ++i) {
+    src.col(i) = (*model)[i].getVector3fMap().template cast<Scalar>();
+    dst.col(i) = (pose * (*model)[i].getVector3fMap()).template cast<Scalar>();
+    weights(i) = 1;
+  }
+  bench("rigid solve " + kernel, modelPts, 0, [&]() {
+    typename Registration::Transform t =
+      Registration::estimateRigidTransform(src, dst, weights, modelPts);
+    sink = t(0, 3);
+  });
+}
+
+static void benchRigidSolve(size_t modelPts)
+{
+  if (modelPts == 4) {
+    benchRigidSolve<float, 4>("<float,4>", modelPts);
+  }
+  benchRigidSolve<float, Eigen::Dynamic>("<float,N>", modelPts);
+  benchRigidSolve<double, Eigen::Dynamic>("<double,N>", modelPts);
+}
+
+static void benchConversions()
+{
+  Eigen::Affine3f pose = pcl::getTransformation(1, 2, 3, 0.1, 0.2, 0.3);
+  float x, y, z, roll, pitch, yaw;
+  bench("affine -> euler", 0, 0, [&]() {
+    pcl::getTranslationAndEulerAngles(pose, x, y, z, roll, pitch, yaw);
+    sink = yaw;
+  });
+  bench("euler -> affine", 0, 0, [&]() {
+    Eigen::Affine3f t = pcl::getTransformation(x, y, z, roll, pitch, yaw);
+    sink = t(0, 0);
+  });
+  bench("affine -> quaternion", 0, 0, [&]() {
+    Eigen::Quaternionf q(pose.rotation());
+    sink = q.w();
+  });
+  Eigen::Quaternionf q(pose.rotation());
+  bench("quaternion -> affine", 0, 0, [&]() {
+    Eigen::Affine3f t = Eigen::Translation3f(x, y, z) * q;
+    sink = t(0, 0);
+  });
+}
+
+// the motion model every registration result goes through
+static void benchDynamicsCheck()
+{
+  DynamicsConfiguration dynConf;
+  dynConf.maxXVelocity = 2;
+  dynConf.maxYVelocity = 2;
+  dynConf.maxZVelocity = 3;
+  dynConf.maxPitchRate = 20;
+  dynConf.maxRollRate = 20;
+  dynConf.maxYawRate = 10;
+  dynConf.maxRoll = 1.4;
+  dynConf.maxPitch = 1.4;
+  dynConf.maxFitnessScore = 0.001;
+  Eigen::Affine3f last = pcl::getTransformation(1, 2, 1, 0.01, 0.02, 0.3);
+  Eigen::Affine3f next = pcl::getTransformation(1.01, 2, 1, 0.01, 0.02, 0.31);
+  float dt = 0.01;
+  float fitness = 1e-5;
+
+  bench("dynamics check", 0, 0, [&]() {
+    sink = checkDynamics(dynConf, last, next, dt, fitness);
+  });
+}
+
+// the target is the whole frame here; the tracker only passes the
+// markers within an object's correspondence gate
+template <typename Scalar, int NumMarkers>
+static void benchRegistration(const std::string& kernel, size_t modelPts, size_t markers)
+{
+  Cloud::Ptr model = makeModel(modelPts);
+  Eigen::Affine3f pose = pcl::getTransformation(1, 2, 1, 0, 0, 0.3);
+  Cloud::Ptr frame = makeFrame(*model, pose, markers);
+  Eigen::Affine3f guess = pcl::getTransformation(1.01, 2, 1, 0, 0, 0.32);
+
+  RigidRegistration<Scalar, NumMarkers> registration;
+  registration.setModel(*model);
+  registration.setTarget(*frame);
+  registration.setMaxCorrespondenceDistance(0.05);
+  registration.setMaximumIterations(5);
+  bench("align " + kernel, modelPts, markers, [&]() {
+    registration.align(guess.cast<Scalar>());
+    sink = registration.fitnessScore();
+  });
+  // without iterations, align only evaluates the fitness at the guess
+  registration.setMaximumIterations(0);
+  bench("fitness " + kernel, modelPts, markers, [&]() {
+    registration.align(pose.cast<Scalar>());
+    sink = registration.fitnessScore();
+  });
+}
+
+static void benchRegistration(size_t modelPts, size_t markers)
+{
+  if (modelPts == 4) {
+    benchRegistration<float, 4>("<float,4>", modelPts, markers);
+  }
+  benchRegistration<float, Eigen::Dynamic>("<float,N>", modelPts, markers);
+  benchRegistration<double, Eigen::Dynamic>("<double,N>", modelPts, markers);
+}
+
+class BenchPlayer : public PointCloudPlayer
+{
+public:
+  size_t size() const { return clouds.size(); }
+};
+
+static void benchDecode(size_t markers)
+{
+  static size_t const frames = 100;
+  std::string path = "/tmp/libobjecttracker_microbench.log";
+  {
+    PointCloudLogger logger(path);
+    Cloud::Ptr frame = makeFrame(Cloud(), Eigen::Affine3f::Identity(), markers);
+    for (size_t i = 0; i < frames; ++i) {
+      logger.log(frame);
+    }
+    logger.flush();
+  }
+  // time is per load of the whole log
+  std::string name = "cloud decode (x" + std::to_string(frames) + ")";
+  bench(name, 0, markers, [&]() {
+    BenchPlayer player;
+    player.load(path);
+    sink = player.size();
+  });
+  std::remove(path.c_str());
+}
+
+int main(int argc, char **argv)
+{
+  if (argc > 1) {
+    filter = argv[1];
+  }
+
+  printf("%-24s %6s %8s %14s\n", "kernel", "model", "markers", "ns/call");
+
+  for (size_t modelPts : {4, 8, 16}) {
+    for (size_t markers : {10, 100, 1000, 5000}) {
+      benchCorrespondences(modelPts, markers);
+    }
+  }
+  for (size_t modelPts : {4, 8, 16}) {
+    benchRigidSolve(modelPts);
+  }
+  benchConversions();
+  benchDynamicsCheck();
+  for (size_t modelPts : {4, 8, 16}) {
+    for (size_t markers : {10, 100, 1000, 5000}) {
+      benchRegistration(modelPts, markers);
+    }
+  }
+  for (size_t markers : {10, 100, 1000, 5000}) {
+    benchDecode(markers);
+  }
+}
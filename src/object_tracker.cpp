@@ -1,4 +1,13 @@
 #include "libobjecttracker/object_tracker.h"
+#include "libobjecttracker/metrics_exporter.h"
+#include "libobjecttracker/state_persister.h"
+#include "libobjecttracker/pose_predictor.h"
+#include "libobjecttracker/background_model.h"
+#include "libobjecttracker/preprocessor.h"
+#include "libobjecttracker/identification.h"
+#include "libobjecttracker/particle_filter.h"
+#include "libobjecttracker/flight_recorder.h"
+#include "libobjecttracker/registration.h"
 
 // PCL
 #include <pcl/point_cloud.h>
@@ -11,6 +20,12 @@
 // TEMP for debug
 #include <cstdio>
 
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <condition_variable>
+#include <thread>
+
 using Point = pcl::PointXYZ;
 using Cloud = pcl::PointCloud<Point>;
 using ICP = pcl::IterativeClosestPoint<Point, Point>;
@@ -30,10 +45,327 @@ static float deltaAngle(float a, float b)
   return atan2(sin(a-b), cos(a-b));
 }
 
+static bool isFinite(const Point& p)
+{
+  return std::isfinite(p.x) && std::isfinite(p.y) && std::isfinite(p.z);
+}
+
+// pairs with this cost are never preferred over admissible ones
+static const float INADMISSIBLE_COST = 1e9f;
+
+// Minimum cost assignment of rows to columns (Hungarian method,
+// O(n^2 m) for n <= m). Returns the column of each row, or -1 if
+// there are more rows than columns and the row is left out.
+static std::vector<int> minCostAssignment(const Eigen::MatrixXf& cost)
+{
+  if (cost.rows() > cost.cols()) {
+    std::vector<int> byColumn = minCostAssignment(cost.transpose());
+    std::vector<int> result(cost.rows(), -1);
+    for (size_t j = 0; j < byColumn.size(); ++j) {
+      result[byColumn[j]] = j;
+    }
+    return result;
+  }
+
+  int const n = cost.rows();
+  int const m = cost.cols();
+  // potentials and matching, 1-based with column 0 as the free root
+  std::vector<double> u(n + 1, 0), v(m + 1, 0), minv(m + 1);
+  std::vector<int> p(m + 1, 0), way(m + 1, 0);
+  std::vector<bool> used(m + 1);
+  for (int i = 1; i <= n; ++i) {
+    p[0] = i;
+    int j0 = 0;
+    std::fill(minv.begin(), minv.end(), DBL_MAX);
+    std::fill(used.begin(), used.end(), false);
+    do {
+      used[j0] = true;
+      int const i0 = p[j0];
+      double delta = DBL_MAX;
+      int j1 = 0;
+      for (int j = 1; j <= m; ++j) {
+        if (used[j]) {
+          continue;
+        }
+        double const reduced = cost(i0 - 1, j - 1) - u[i0] - v[j];
+        if (reduced < minv[j]) {
+          minv[j] = reduced;
+          way[j] = j0;
+        }
+        if (minv[j] < delta) {
+          delta = minv[j];
+          j1 = j;
+        }
+      }
+      for (int j = 0; j <= m; ++j) {
+        if (used[j]) {
+          u[p[j]] += delta;
+          v[j] -= delta;
+        } else {
+          minv[j] -= delta;
+        }
+      }
+      j0 = j1;
+    } while (p[j0] != 0);
+    do {
+      int const j1 = way[j0];
+      p[j0] = p[j1];
+      j0 = j1;
+    } while (j0 != 0);
+  }
+
+  std::vector<int> result(n, -1);
+  for (int j = 1; j <= m; ++j) {
+    if (p[j] != 0) {
+      result[p[j] - 1] = j - 1;
+    }
+  }
+  return result;
+}
+
+// distance of the farthest marker from the object's origin
+static float markerConfigurationRadius(const Cloud& markers)
+{
+  float radius = 0;
+  for (auto const &p : markers) {
+    radius = std::max(radius, pcl2eig(p).norm());
+  }
+  return radius;
+}
+
+static std::vector<float> markerConfigurationRadii(
+  const std::vector<libobjecttracker::MarkerConfiguration>& markerConfigurations)
+{
+  std::vector<float> radii;
+  for (const auto& config : markerConfigurations) {
+    radii.push_back(markerConfigurationRadius(*config));
+  }
+  return radii;
+}
+
+// pairwise marker distances of each configuration
+static std::vector<Eigen::MatrixXf> markerConfigurationDistances(
+  const std::vector<libobjecttracker::MarkerConfiguration>& markerConfigurations)
+{
+  std::vector<Eigen::MatrixXf> tables;
+  for (const auto& config : markerConfigurations) {
+    size_t const n = config->size();
+    Eigen::MatrixXf table(n, n);
+    for (size_t i = 0; i < n; ++i) {
+      for (size_t j = 0; j < n; ++j) {
+        table(i, j) = (pcl2eig((*config)[i]) - pcl2eig((*config)[j])).norm();
+      }
+    }
+    tables.push_back(table);
+  }
+  return tables;
+}
+
+// Rotations about the vertical axis through the centroid that map each
+// configuration onto itself within tolerance (e.g. 180deg for one that
+// is symmetric front to back), refit in closed form to the permuted
+// markers. Scanned in 1deg steps; the best step of each run within
+// tolerance is kept.
+static std::vector<libobjecttracker::MarkerConfigurationSymmetries> markerConfigurationSymmetries(
+  const std::vector<libobjecttracker::MarkerConfiguration>& markerConfigurations,
+  float tolerance)
+{
+  typedef libobjecttracker::RigidRegistration<float, Eigen::Dynamic> Registration;
+  std::vector<libobjecttracker::MarkerConfigurationSymmetries> result;
+  for (const auto& config : markerConfigurations) {
+    libobjecttracker::MarkerConfigurationSymmetries symmetries;
+    int const n = config->size();
+    if (n < 3) {
+      result.push_back(symmetries);
+      continue;
+    }
+    Eigen::Matrix3Xf points(3, n);
+    for (int i = 0; i < n; ++i) {
+      points.col(i) = pcl2eig((*config)[i]);
+    }
+    Eigen::Vector3f const centroid = points.rowwise().mean();
+
+    // largest distance of a rotated marker to its nearest marker
+    auto error = [&](int degrees, std::vector<int>* nearest) {
+      Eigen::Matrix3f const r = Eigen::AngleAxisf(
+        degrees * M_PI / 180, Eigen::Vector3f::UnitZ()).toRotationMatrix();
+      float worst = 0;
+      for (int i = 0; i < n; ++i) {
+        Eigen::Vector3f const p = r * (points.col(i) - centroid) + centroid;
+        int j;
+        float const d = (points.colwise() - p).colwise().norm().minCoeff(&j);
+        worst = std::max(worst, d);
+        if (nearest) {
+          (*nearest)[i] = j;
+        }
+      }
+      return worst;
+    };
+
+    // runs that touch 0deg are small rotations, not symmetries
+    int best = -1;
+    int runStart = -1;
+    float bestError = tolerance;
+    for (int degrees = 1; degrees < 360; ++degrees) {
+      float const e = error(degrees, nullptr);
+      if (e <= tolerance) {
+        if (runStart < 0) {
+          runStart = degrees;
+        }
+        if (e < bestError) {
+          best = degrees;
+          bestError = e;
+        }
+      } else if (runStart >= 0) {
+        if (runStart > 1 && best >= 0) {
+          std::vector<int> nearest(n);
+          error(best, &nearest);
+          Eigen::Matrix3Xf permuted(3, n);
+          for (int i = 0; i < n; ++i) {
+            permuted.col(i) = points.col(nearest[i]);
+          }
+          symmetries.push_back(Registration::estimateRigidTransform(
+            points, permuted, Registration::WeightVector::Ones(n), n));
+        }
+        best = -1;
+        runStart = -1;
+        bestError = tolerance;
+      }
+    }
+    result.push_back(symmetries);
+  }
+  return result;
+}
+
+static bool samePose(const Eigen::Affine3f& a, const Eigen::Affine3f& b)
+{
+  return (a.translation() - b.translation()).norm() < 0.01
+    && Eigen::Quaternionf(a.rotation()).angularDistance(Eigen::Quaternionf(b.rotation())) < 0.1;
+}
+
+// NaN/inf coordinates would poison the search structures and ICP,
+// so we drop them up front (copying only if there are any)
+static Cloud::ConstPtr finitePoints(Cloud::ConstPtr cloud)
+{
+  auto firstBad = std::find_if_not(cloud->begin(), cloud->end(), isFinite);
+  if (firstBad == cloud->end()) {
+    return cloud;
+  }
+  Cloud::Ptr filtered(new Cloud);
+  filtered->reserve(cloud->size());
+  for (auto const &p : *cloud) {
+    if (isFinite(p)) {
+      filtered->push_back(p);
+    }
+  }
+  return filtered;
+}
+
 namespace libobjecttracker {
 
+// per-thread scratch space for tracking objects
+// (kept across frames, see setNumThreads)
+struct ObjectTracker::TrackingContext
+{
+  TrackingContext()
+    : kdtree(nullptr)
+    , markers()
+    , gated(new Cloud)
+  {
+  }
+
+  // all markers of the frame
+  const pcl::KdTreeFLANN<Point>* kdtree;
+  Cloud::ConstPtr markers;
+  // markers within the correspondence gate of the current object
+  Cloud::Ptr gated;
+  std::vector<int> candidates;
+  std::vector<int> nearestIdx;
+  std::vector<float> nearestSqrDist;
+  // per model marker: associated frame marker, -1 if none
+  std::vector<int> associated;
+};
+
+// Threads that track objects in parallel, started once by
+// setNumThreads. run() wakes them for each frame and returns
+// once all of them are done.
+struct ObjectTracker::WorkerPool
+{
+  explicit WorkerPool(size_t numWorkers)
+    : job(nullptr)
+    , generation(0)
+    , busy(0)
+    , stop(false)
+  {
+    for (size_t i = 0; i < numWorkers; ++i) {
+      threads.emplace_back(&WorkerPool::loop, this, i + 1);
+    }
+  }
+
+  ~WorkerPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+    }
+    start.notify_all();
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+
+  // job(1..n) runs on the workers, job(0) on the calling thread
+  void run(const std::function<void(size_t)>& f)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      job = &f;
+      busy = threads.size();
+      ++generation;
+    }
+    start.notify_all();
+    f(0);
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return busy == 0; });
+  }
+
+  void loop(size_t t)
+  {
+    uint64_t seen = 0;
+    while (true) {
+      const std::function<void(size_t)>* f;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        start.wait(lock, [this, seen] { return stop || generation != seen; });
+        if (stop) {
+          return;
+        }
+        seen = generation;
+        f = job;
+      }
+      (*f)(t);
+      std::lock_guard<std::mutex> lock(mutex);
+      if (--busy == 0) {
+        done.notify_one();
+      }
+    }
+  }
+
+  std::vector<std::thread> threads;
+  std::mutex mutex;
+  std::condition_variable start;
+  std::condition_variable done;
+  const std::function<void(size_t)>* job;
+  uint64_t generation;
+  size_t busy;
+  bool stop;
+};
+
 /////////////////////////////////////////////////////////////
 
+const uint32_t Object::NoLabel;
+const size_t ObjectTracker::InvalidObject;
+
 Object::Object(
   size_t markerConfigurationIdx,
   size_t dynamicsConfigurationIdx,
@@ -42,8 +374,19 @@ Object::Object(
   , m_dynamicsConfigurationIdx(dynamicsConfigurationIdx)
   , m_lastTransformation(initialTransformation)
   , m_initialTransformation(initialTransformation)
+  , m_velocity(0, 0, 0)
   , m_lastValidTransform()
+  , m_lastPoseChange()
   , m_lastTransformationValid(false)
+  , m_active(true)
+  , m_awaitingInitialization(true)
+  , m_velocityRestored(false)
+  , m_markersUsed(0)
+  , m_history()
+  , m_hypotheses()
+  , m_particleFilter()
+  , m_markerLabels()
+  , m_trackedByLabels(false)
 {
 }
 
@@ -73,9 +416,51 @@ ObjectTracker::ObjectTracker(
   , m_objects(objects)
   , m_initialized(false)
   , m_init_attempts(0)
+  , m_numThreads(1)
+  , m_workers()
+  , m_contexts()
+  , m_maxGatingInterval(1.0)
+  , m_poseHistoryCapacity(PoseHistory::DefaultCapacity)
+  , m_stationaryThreshold(0)
+  , m_markerAssociationGate(0)
+  , m_markerLabelTolerance(0.005)
+  , m_hasLabels(false)
+  , m_labeledMarkers(new Cloud)
+  , m_frameLabels()
+  , m_labelIndex()
+  , m_robustLoss(RobustLoss::None)
+  , m_robustLossParameter(0)
+  , m_minVisibleMarkers(0)
+  , m_visibleMarkerTolerance(0.005)
+  , m_maxPoseHypotheses(1)
+  , m_symmetryTolerance(0.01)
+  , m_markerConfigurationSymmetries()
   , m_logWarn()
+  , m_metrics()
+  , m_statePersister()
+  , m_posePredictor()
+  , m_preprocessor()
+  , m_flightRecorder()
+  , m_initializationFailed(false)
+  , m_background()
+  , m_configurationIndex()
+  , m_identificationTolerance(0.005)
+  , m_numSlots(objects.size())
+  , m_hasPendingConfigurations(false)
 {
+  m_markerConfigurationRadii = markerConfigurationRadii(m_markerConfigurations);
+  m_markerConfigurationDistances = markerConfigurationDistances(m_markerConfigurations);
+  updateKernelBuckets();
+  // objects copied from another tracker must not share its filters
+  for (auto& object : m_objects) {
+    object.m_particleFilter.reset();
+  }
+  updateParticleFilters();
+  setNumThreads(1);
+}
 
+ObjectTracker::~ObjectTracker()
+{
 }
 
 void ObjectTracker::update(Cloud::Ptr pointCloud)
@@ -86,7 +471,98 @@ void ObjectTracker::update(Cloud::Ptr pointCloud)
 void ObjectTracker::update(std::chrono::high_resolution_clock::time_point time,
   Cloud::Ptr pointCloud)
 {
-  runICP(time, pointCloud);
+  applyPendingChanges();
+
+  if (!m_metrics && !m_flightRecorder) {
+    runICP(time, preprocess(pointCloud));
+  } else {
+    if (m_flightRecorder) {
+      m_flightRecorder->recordInput(time, *pointCloud, m_objects);
+    }
+    m_initializationFailed = false;
+    auto start = std::chrono::high_resolution_clock::now();
+    runICP(time, preprocess(pointCloud));
+    std::chrono::duration<double> latency =
+      std::chrono::high_resolution_clock::now() - start;
+    if (m_metrics) {
+      m_metrics->recordFrame(time, latency.count(), m_objects);
+    }
+    if (m_flightRecorder) {
+      m_flightRecorder->recordOutput(m_objects, latency.count(), m_initializationFailed);
+    }
+  }
+
+  updatePoseViews();
+
+  if (m_statePersister) {
+    m_statePersister->record(time, m_objects);
+  }
+
+  if (m_posePredictor) {
+    m_posePredictor->publish(time, m_objects);
+  }
+}
+
+void ObjectTracker::update(std::chrono::high_resolution_clock::time_point time,
+  pcl::PointCloud<pcl::PointXYZL>::ConstPtr labeledCloud)
+{
+  Cloud::Ptr pointCloud(new Cloud);
+  pointCloud->reserve(labeledCloud->size());
+  m_labeledMarkers->clear();
+  m_frameLabels.clear();
+  m_labelIndex.clear();
+  // the tables keep their capacity, so this only allocates when a frame
+  // has more markers than any frame before
+  m_labelIndex.reserve(labeledCloud->size());
+  for (const auto& p : *labeledCloud) {
+    Point const q(p.x, p.y, p.z);
+    pointCloud->push_back(q);
+    if (!isFinite(q) || p.label == Object::NoLabel) {
+      continue;
+    }
+    m_labelIndex.push_back(std::make_pair(p.label, (int)m_labeledMarkers->size()));
+    m_labeledMarkers->push_back(q);
+    m_frameLabels.push_back(p.label);
+  }
+  std::sort(m_labelIndex.begin(), m_labelIndex.end());
+  for (size_t i = 1; i < m_labelIndex.size(); ++i) {
+    if (m_labelIndex[i].first == m_labelIndex[i - 1].first) {
+      m_labelIndex[i].second = -1;
+      m_labelIndex[i - 1].second = -1;
+    }
+  }
+
+  m_hasLabels = true;
+  update(time, pointCloud);
+  m_hasLabels = false;
+}
+
+Cloud::ConstPtr ObjectTracker::preprocess(Cloud::ConstPtr pointCloud)
+{
+  Cloud::ConstPtr markers = m_preprocessor
+    ? m_preprocessor->process(pointCloud)
+    : finitePoints(pointCloud);
+  if (!m_background) {
+    return markers;
+  }
+
+  // background is never removed around any object's last pose
+  m_objectSpheres.clear();
+  for (const auto& object : m_objects) {
+    if (object.m_active) {
+      Eigen::Vector4f sphere;
+      sphere << object.center(), m_markerConfigurationRadii[object.m_markerConfigurationIdx];
+      m_objectSpheres.push_back(sphere);
+    }
+  }
+  return m_background->filter(markers, m_objectSpheres);
+}
+
+int ObjectTracker::labeledMarker(uint32_t label) const
+{
+  auto it = std::lower_bound(m_labelIndex.begin(), m_labelIndex.end(),
+    std::make_pair(label, INT_MIN));
+  return (it != m_labelIndex.end() && it->first == label) ? it->second : -1;
 }
 
 const std::vector<Object>& ObjectTracker::objects() const
@@ -94,13 +570,392 @@ const std::vector<Object>& ObjectTracker::objects() const
   return m_objects;
 }
 
+void ObjectTracker::updatePoseViews()
+{
+  size_t const n = m_objects.size();
+  if (m_poseValid.size() != n) {
+    // new slots start out invalid, and are reported as changed
+    // once they get a pose
+    m_posePositions.resize(3 * n, 0);
+    m_poseOrientations.resize(4 * n, 0);
+    m_poseValid.resize(n, 0);
+    m_poseActive.resize(n, 0);
+    m_poseChanged.resize(n, 0);
+    m_poseStamps.resize(n);
+  }
+
+  for (size_t i = 0; i < n; ++i) {
+    const Object& object = m_objects[i];
+    bool const valid = object.m_active && object.m_lastTransformationValid;
+    // a pose confirmed unchanged keeps the stamp it was first reported with
+    bool const updated = valid && object.m_lastPoseChange != m_poseStamps[i];
+    m_poseChanged[i] = updated || valid != (m_poseValid[i] != 0);
+    m_poseValid[i] = valid;
+    m_poseActive[i] = object.m_active;
+    if (!updated) {
+      continue;
+    }
+    // convert only poses that changed
+    Eigen::Map<Eigen::Vector3f> position(&m_posePositions[3 * i]);
+    Eigen::Map<Eigen::Quaternionf> orientation(&m_poseOrientations[4 * i]);
+    position = object.m_lastTransformation.translation();
+    orientation = Eigen::Quaternionf(object.m_lastTransformation.rotation());
+    m_poseStamps[i] = object.m_lastPoseChange;
+  }
+}
+
+size_t ObjectTracker::addObject(const Object& object)
+{
+  std::lock_guard<std::mutex> lock(m_pendingMutex);
+  // check against the tables the object will be tracked with
+  size_t const numMarkerConfigurations = m_hasPendingConfigurations
+    ? m_pendingMarkerConfigurations.size() : m_markerConfigurations.size();
+  size_t const numDynamicsConfigurations = m_hasPendingConfigurations
+    ? m_pendingDynamicsConfigurations.size() : m_dynamicsConfigurations.size();
+  if (object.m_markerConfigurationIdx >= numMarkerConfigurations
+      || object.m_dynamicsConfigurationIdx >= numDynamicsConfigurations) {
+    logWarn("addObject: object refers to a configuration that does not exist");
+    return InvalidObject;
+  }
+  size_t idx;
+  if (!m_freeSlots.empty()) {
+    idx = m_freeSlots.back();
+    m_freeSlots.pop_back();
+  } else {
+    idx = m_numSlots++;
+  }
+  m_pendingAdds.push_back(std::make_pair(idx, object));
+  return idx;
+}
+
+void ObjectTracker::removeObject(size_t idx)
+{
+  std::lock_guard<std::mutex> lock(m_pendingMutex);
+  m_pendingRemoves.push_back(idx);
+}
+
+void ObjectTracker::reserveObjects(size_t count)
+{
+  m_objects.reserve(count);
+  m_posePositions.reserve(3 * count);
+  m_poseOrientations.reserve(4 * count);
+  m_poseValid.reserve(count);
+  m_poseActive.reserve(count);
+  m_poseChanged.reserve(count);
+  m_poseStamps.reserve(count);
+}
+
+void ObjectTracker::setConfigurations(
+  const std::vector<DynamicsConfiguration>& dynamicsConfigurations,
+  const std::vector<MarkerConfiguration>& markerConfigurations)
+{
+  // deep copy here, so the caller can keep modifying its clouds and
+  // update() only has to swap the tables
+  std::vector<MarkerConfiguration> markers;
+  markers.reserve(markerConfigurations.size());
+  for (const auto& config : markerConfigurations) {
+    markers.push_back(MarkerConfiguration(new Cloud(*config)));
+  }
+
+  std::vector<float> radii = markerConfigurationRadii(markers);
+  std::vector<Eigen::MatrixXf> distances = markerConfigurationDistances(markers);
+  // the descriptors are built here as well, off the tracking thread
+  std::shared_ptr<ConfigurationIndex> index;
+  if (m_configurationIndex) {
+    index.reset(new ConfigurationIndex(markers, m_identificationTolerance));
+  }
+  std::vector<MarkerConfigurationSymmetries> symmetries;
+  if (m_maxPoseHypotheses > 1) {
+    symmetries = markerConfigurationSymmetries(markers, m_symmetryTolerance);
+  }
+
+  std::lock_guard<std::mutex> lock(m_pendingMutex);
+  m_pendingDynamicsConfigurations = dynamicsConfigurations;
+  m_pendingMarkerConfigurations.swap(markers);
+  m_pendingMarkerConfigurationRadii.swap(radii);
+  m_pendingMarkerConfigurationDistances.swap(distances);
+  m_pendingConfigurationIndex.swap(index);
+  m_pendingMarkerConfigurationSymmetries.swap(symmetries);
+  m_hasPendingConfigurations = true;
+}
+
+void ObjectTracker::applyPendingChanges()
+{
+  std::lock_guard<std::mutex> lock(m_pendingMutex);
+
+  bool const changed = m_hasPendingConfigurations
+    || !m_pendingAdds.empty() || !m_pendingRemoves.empty();
+
+  if (m_hasPendingConfigurations) {
+    m_hasPendingConfigurations = false;
+    auto fits = [this](const Object& object) {
+      return object.m_markerConfigurationIdx < m_pendingMarkerConfigurations.size()
+        && object.m_dynamicsConfigurationIdx < m_pendingDynamicsConfigurations.size();
+    };
+    bool valid = true;
+    for (const auto& object : m_objects) {
+      if (object.m_active && !fits(object)) {
+        valid = false;
+      }
+    }
+    for (const auto& add : m_pendingAdds) {
+      if (!fits(add.second)) {
+        valid = false;
+      }
+    }
+    if (valid) {
+      m_markerConfigurations.swap(m_pendingMarkerConfigurations);
+      m_markerConfigurationRadii.swap(m_pendingMarkerConfigurationRadii);
+      m_markerConfigurationDistances.swap(m_pendingMarkerConfigurationDistances);
+      m_configurationIndex.swap(m_pendingConfigurationIndex);
+      m_markerConfigurationSymmetries.swap(m_pendingMarkerConfigurationSymmetries);
+      m_dynamicsConfigurations.swap(m_pendingDynamicsConfigurations);
+    } else {
+      logWarn("Configuration update ignored: "
+        "an object refers to a configuration that no longer exists");
+    }
+    // the old tables are released outside of the tracking loop,
+    // next time the configurations are set
+  }
+
+  for (auto& add : m_pendingAdds) {
+    // the other objects keep their state; only the new one
+    // needs to be initialized
+    Object& object = add.second;
+    if (object.m_history.capacity() != m_poseHistoryCapacity) {
+      object.m_history = PoseHistory(m_poseHistoryCapacity);
+    }
+    // checked in addObject, unless the configuration update that
+    // object was meant for has been ignored
+    object.m_active = object.m_markerConfigurationIdx < m_markerConfigurations.size()
+      && object.m_dynamicsConfigurationIdx < m_dynamicsConfigurations.size();
+    object.m_awaitingInitialization = object.m_active;
+    object.m_lastTransformationValid = false;
+    object.m_particleFilter.reset();
+    if (!object.m_active) {
+      logWarn("Added object ignored: it refers to a configuration that does not exist");
+      m_freeSlots.push_back(add.first);
+    }
+    if (add.first < m_objects.size()) {
+      m_objects[add.first] = object;
+    } else {
+      if (m_objects.size() == m_objects.capacity()) {
+        logWarn("Object storage reallocated, see reserveObjects()");
+      }
+      m_objects.push_back(object);
+    }
+  }
+  m_pendingAdds.clear();
+
+  for (size_t idx : m_pendingRemoves) {
+    if (idx >= m_objects.size() || !m_objects[idx].m_active) {
+      continue;
+    }
+    m_objects[idx].m_active = false;
+    m_objects[idx].m_lastTransformationValid = false;
+    m_freeSlots.push_back(idx);
+  }
+  m_pendingRemoves.clear();
+
+  if (changed) {
+    updateKernelBuckets();
+    updateParticleFilters();
+  }
+}
+
 void ObjectTracker::setLogWarningCallback(
   std::function<void(const std::string&)> logWarn)
 {
   m_logWarn = logWarn;
 }
 
-bool ObjectTracker::initialize(Cloud::ConstPtr markersConst)
+void ObjectTracker::setNumThreads(size_t numThreads)
+{
+  m_numThreads = std::max<size_t>(numThreads, 1);
+  m_workers.reset(m_numThreads > 1 ? new WorkerPool(m_numThreads - 1) : nullptr);
+  m_contexts.resize(m_numThreads);
+  for (auto& context : m_contexts) {
+    if (!context) {
+      context.reset(new TrackingContext);
+    }
+  }
+}
+
+void ObjectTracker::setPoseHistoryCapacity(size_t capacity)
+{
+  m_poseHistoryCapacity = capacity;
+  for (auto& object : m_objects) {
+    object.m_history = PoseHistory(capacity);
+  }
+}
+
+void ObjectTracker::setIdentification(bool enable, double tolerance)
+{
+  m_identificationTolerance = tolerance;
+  m_configurationIndex.reset(enable
+    ? new ConfigurationIndex(m_markerConfigurations, tolerance)
+    : nullptr);
+  // configurations set but not applied yet need a matching index
+  std::lock_guard<std::mutex> lock(m_pendingMutex);
+  if (m_hasPendingConfigurations) {
+    m_pendingConfigurationIndex.reset(enable
+      ? new ConfigurationIndex(m_pendingMarkerConfigurations, tolerance)
+      : nullptr);
+  }
+}
+
+void ObjectTracker::setRobustLoss(RobustLoss loss, double parameter)
+{
+  m_robustLoss = loss;
+  m_robustLossParameter = parameter;
+}
+
+void ObjectTracker::setMinVisibleMarkers(size_t count, double tolerance)
+{
+  m_minVisibleMarkers = count;
+  m_visibleMarkerTolerance = tolerance;
+}
+
+void ObjectTracker::setMaxPoseHypotheses(size_t count, double symmetryTolerance)
+{
+  m_maxPoseHypotheses = std::max<size_t>(count, 1);
+  m_symmetryTolerance = symmetryTolerance;
+  m_markerConfigurationSymmetries.clear();
+  if (m_maxPoseHypotheses > 1) {
+    m_markerConfigurationSymmetries = markerConfigurationSymmetries(
+      m_markerConfigurations, m_symmetryTolerance);
+  }
+  for (auto& object : m_objects) {
+    object.m_hypotheses.clear();
+  }
+  std::lock_guard<std::mutex> lock(m_pendingMutex);
+  if (m_hasPendingConfigurations) {
+    m_pendingMarkerConfigurationSymmetries.clear();
+    if (m_maxPoseHypotheses > 1) {
+      m_pendingMarkerConfigurationSymmetries = markerConfigurationSymmetries(
+        m_pendingMarkerConfigurations, m_symmetryTolerance);
+    }
+  }
+}
+
+void ObjectTracker::setStationaryThreshold(double distance)
+{
+  m_stationaryThreshold = distance;
+}
+
+void ObjectTracker::setMarkerAssociationGate(double distance)
+{
+  m_markerAssociationGate = distance;
+}
+
+void ObjectTracker::setMarkerLabelTolerance(double distance)
+{
+  m_markerLabelTolerance = distance;
+}
+
+void ObjectTracker::setMaxGatingInterval(double seconds)
+{
+  m_maxGatingInterval = seconds;
+}
+
+void ObjectTracker::setMetricsExporter(
+  std::shared_ptr<MetricsExporter> metrics)
+{
+  m_metrics = metrics;
+}
+
+void ObjectTracker::setStatePersister(
+  std::shared_ptr<StatePersister> persister)
+{
+  m_statePersister = persister;
+}
+
+void ObjectTracker::setPreprocessor(
+  std::shared_ptr<Preprocessor> preprocessor)
+{
+  m_preprocessor = preprocessor;
+}
+
+void ObjectTracker::setBackgroundModel(
+  std::shared_ptr<BackgroundModel> background)
+{
+  m_background = background;
+}
+
+void ObjectTracker::setPosePredictor(
+  std::shared_ptr<PosePredictor> predictor)
+{
+  m_posePredictor = predictor;
+}
+
+void ObjectTracker::setFlightRecorder(
+  std::shared_ptr<FlightRecorder> recorder)
+{
+  m_flightRecorder = recorder;
+}
+
+bool ObjectTracker::restoreState(
+  const std::vector<ObjectState>& states,
+  std::chrono::high_resolution_clock::time_point now,
+  std::chrono::high_resolution_clock::duration maxAge,
+  std::chrono::system_clock::time_point wallNow)
+{
+  if (states.size() != m_objects.size()) {
+    logWarn("Saved state does not match the configured objects.");
+    return false;
+  }
+
+  size_t restored = 0;
+  for (size_t i = 0; i < m_objects.size(); ++i) {
+    Object& object = m_objects[i];
+    const ObjectState& state = states[i];
+    if (!object.m_active) {
+      continue;
+    }
+    object.m_awaitingInitialization = true;
+
+    // the saved stamp is on the wall clock; it is moved onto the
+    // tracker's clock through the age
+    std::chrono::system_clock::time_point wallStamp(
+      std::chrono::duration_cast<std::chrono::system_clock::duration>(
+        std::chrono::nanoseconds(state.stamp)));
+    if (!state.valid
+        || state.markerConfigurationIdx != object.m_markerConfigurationIdx
+        || state.dynamicsConfigurationIdx != object.m_dynamicsConfigurationIdx
+        || wallStamp > wallNow
+        || wallNow - wallStamp > maxAge) {
+      continue;
+    }
+    std::chrono::high_resolution_clock::time_point const stamp = now
+      - std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(wallNow - wallStamp);
+
+    std::chrono::duration<double> age = now - stamp;
+    Eigen::Vector3f velocity(state.velocity[0], state.velocity[1], state.velocity[2]);
+    Eigen::Vector3f position(state.position[0], state.position[1], state.position[2]);
+    Eigen::Quaternionf orientation(
+      state.orientation[3], state.orientation[0], state.orientation[1], state.orientation[2]);
+    position += velocity * age.count();
+
+    object.m_lastTransformation = Eigen::Translation3f(position) * orientation.normalized();
+    object.m_velocity = velocity;
+    object.m_velocityRestored = true;
+    // keep the saved stamp, so the correspondence search
+    // covers everything the object could have done since
+    object.m_lastValidTransform = stamp;
+    object.m_lastPoseChange = stamp;
+    object.m_lastTransformationValid = false;
+    object.m_awaitingInitialization = false;
+    ++restored;
+  }
+
+  // objects that could not be restored are initialized
+  // individually, like objects added at runtime
+  m_initialized = restored > 0;
+  return m_initialized;
+}
+
+bool ObjectTracker::initialize(Cloud::ConstPtr markersConst,
+  const std::vector<size_t>& objectIndicesAll)
 {
   if (markersConst->size() == 0) {
     return false;
@@ -110,7 +965,14 @@ bool ObjectTracker::initialize(Cloud::ConstPtr markersConst)
   // once they are assigned to an object
   Cloud::Ptr markers(new Cloud(*markersConst));
 
-  size_t const nObjs = m_objects.size();
+  std::vector<size_t> const remaining = m_configurationIndex
+    ? initializeIdentifiedObjects(markers, objectIndicesAll)
+    : objectIndicesAll;
+  std::vector<size_t> const& objectIndices = remaining;
+  if (objectIndices.empty() || markers->empty()) {
+    ++m_init_attempts;
+    return objectIndices.empty();
+  }
 
   ICP icp;
   icp.setMaximumIterations(5);
@@ -123,23 +985,13 @@ bool ObjectTracker::initialize(Cloud::ConstPtr markersConst)
   pcl::KdTreeFLANN<Point> kdtree;
   kdtree.setInputCloud(markers);
 
-  // compute the distance between the closest 2 objects in the nominal configuration
-  // we will use this value to limit allowed deviation from nominal positions
-  float closest = FLT_MAX;
-  for (int i = 0; i < nObjs; ++i) {
-    auto pi = m_objects[i].initialCenter();
-    for (int j = i + 1; j < nObjs; ++j) {
-      float dist = (pi - m_objects[j].initialCenter()).norm();
-      closest = std::min(closest, dist);
-    }
-  }
-  float const max_deviation = closest / 3;
+  float const max_deviation = maxInitializationDeviation(objectIndices);
 
   //printf("Object tracker: limiting distance from nominal position "
   //  "to %f meters\n", max_deviation);
 
   bool allFitsGood = true;
-  for (int iObj = 0; iObj < nObjs; ++iObj) {
+  for (size_t iObj : objectIndices) {
     Object& object = m_objects[iObj];
     Cloud::Ptr &objMarkers =
       m_markerConfigurations[object.m_markerConfigurationIdx];
@@ -212,6 +1064,7 @@ bool ObjectTracker::initialize(Cloud::ConstPtr markersConst)
     // unavailable to all other objects so we don't double-assign markers
     // (TODO: this is so greedy... do we need a more global approach?)
     object.m_lastTransformation = bestTransformation;
+    object.m_awaitingInitialization = false;
     // remove highest indices first
     std::sort(objTakePts.rbegin(), objTakePts.rend());
     for (int idx : objTakePts) {
@@ -226,6 +1079,103 @@ bool ObjectTracker::initialize(Cloud::ConstPtr markersConst)
   return allFitsGood;
 }
 
+float ObjectTracker::maxInitializationDeviation(
+  const std::vector<size_t>& objectIndices) const
+{
+  // compute the distance between the closest 2 objects in the nominal configuration
+  // we will use this value to limit allowed deviation from nominal positions
+  // (objects that are already tracked are compared at their current position)
+  float closest = FLT_MAX;
+  for (size_t i : objectIndices) {
+    auto pi = m_objects[i].initialCenter();
+    for (size_t j = 0; j < m_objects.size(); ++j) {
+      const Object& other = m_objects[j];
+      if (j == i || !other.m_active) {
+        continue;
+      }
+      auto pj = other.m_awaitingInitialization ? other.initialCenter() : other.center();
+      closest = std::min(closest, (pi - pj).norm());
+    }
+  }
+  return closest / 3;
+}
+
+std::vector<size_t> ObjectTracker::initializeIdentifiedObjects(
+  Cloud::Ptr markers,
+  const std::vector<size_t>& objectIndices)
+{
+  auto identifications = m_configurationIndex->identify(*markers);
+
+  // The geometry alone decides which configuration a cluster belongs to,
+  // wherever it is. Objects sharing a configuration get its clusters by a
+  // joint assignment minimizing the sum of squared distances to their
+  // initial positions, without a bound; a common offset of the whole
+  // group does not change that assignment.
+  std::vector<bool> assigned(m_objects.size(), false);
+  std::vector<int> takenMarkers;
+  std::vector<bool> grouped(m_objects.size(), false);
+  for (size_t iFirst : objectIndices) {
+    if (grouped[iFirst]) {
+      continue;
+    }
+    size_t const configIdx = m_objects[iFirst].m_markerConfigurationIdx;
+    std::vector<size_t> group;
+    for (size_t iObj : objectIndices) {
+      if (m_objects[iObj].m_markerConfigurationIdx == configIdx) {
+        group.push_back(iObj);
+        grouped[iObj] = true;
+      }
+    }
+    std::vector<size_t> clusters;
+    for (size_t k = 0; k < identifications.size(); ++k) {
+      if (identifications[k].markerConfigurationIdx == configIdx) {
+        clusters.push_back(k);
+      }
+    }
+    if (clusters.empty()) {
+      continue;
+    }
+
+    Eigen::MatrixXf cost(group.size(), clusters.size());
+    for (size_t i = 0; i < group.size(); ++i) {
+      const Object& object = m_objects[group[i]];
+      const DynamicsConfiguration& dynConf = m_dynamicsConfigurations[object.m_dynamicsConfigurationIdx];
+      for (size_t j = 0; j < clusters.size(); ++j) {
+        const Identification& id = identifications[clusters[j]];
+        cost(i, j) = id.fitness < dynConf.maxFitnessScore
+          ? (id.transformation.translation() - object.initialCenter()).squaredNorm()
+          : INADMISSIBLE_COST;
+      }
+    }
+    std::vector<int> assignment = minCostAssignment(cost);
+    for (size_t i = 0; i < group.size(); ++i) {
+      if (assignment[i] < 0 || cost(i, assignment[i]) >= INADMISSIBLE_COST) {
+        continue;
+      }
+      const Identification& id = identifications[clusters[assignment[i]]];
+      Object& object = m_objects[group[i]];
+      object.m_lastTransformation = id.transformation;
+      object.m_awaitingInitialization = false;
+      assigned[group[i]] = true;
+      takenMarkers.insert(takenMarkers.end(), id.markers.begin(), id.markers.end());
+    }
+  }
+
+  std::vector<size_t> remaining;
+  for (size_t iObj : objectIndices) {
+    if (!assigned[iObj]) {
+      remaining.push_back(iObj);
+    }
+  }
+
+  // remove highest indices first
+  std::sort(takenMarkers.rbegin(), takenMarkers.rend());
+  for (int idx : takenMarkers) {
+    markers->erase(markers->begin() + idx);
+  }
+  return remaining;
+}
+
 void ObjectTracker::runICP(std::chrono::high_resolution_clock::time_point stamp,
   Cloud::ConstPtr markers)
 {
@@ -236,7 +1186,20 @@ void ObjectTracker::runICP(std::chrono::high_resolution_clock::time_point stamp,
     return;
   }
 
-  m_initialized = m_initialized || initialize(markers);
+  if (!m_initialized) {
+    std::vector<size_t> objectIndices;
+    for (size_t i = 0; i < m_objects.size(); ++i) {
+      if (m_objects[i].m_active) {
+        m_objects[i].m_awaitingInitialization = true;
+        objectIndices.push_back(i);
+      }
+    }
+    m_initialized = initialize(markers, objectIndices);
+    m_initializationFailed = !m_initialized;
+    if (m_metrics) {
+      m_metrics->recordInitialization(m_initialized);
+    }
+  }
   if (!m_initialized) {
     logWarn(
       "Object tracker initialization failed - "
@@ -246,123 +1209,790 @@ void ObjectTracker::runICP(std::chrono::high_resolution_clock::time_point stamp,
     return;
   }
 
-  ICP icp;
-  // pcl::registration::TransformationEstimationLM<Point, Point>::Ptr trans(new pcl::registration::TransformationEstimationLM<Point, Point>);
-  // pcl::registration::TransformationEstimation2D<Point, Point>::Ptr trans(new pcl::registration::TransformationEstimation2D<Point, Point>);
-  // pcl::registration::TransformationEstimation3DYaw<Point, Point>::Ptr trans(new pcl::registration::TransformationEstimation3DYaw<Point, Point>);
-  // icp.setTransformationEstimation(trans);
+  // the search structure over the whole frame is shared (read-only)
+  // by all threads; it is used to find the markers within each
+  // object's correspondence gate
+  pcl::KdTreeFLANN<Point> kdtree;
+  kdtree.setInputCloud(markers);
 
+  for (auto& context : m_contexts) {
+    context->kdtree = &kdtree;
+    context->markers = markers;
+  }
+  // the model size is chosen once per object set (see
+  // updateKernelBuckets), so the per-object loops run without dispatch
+  trackObjects(stamp);
 
-  // // Set the maximum number of iterations (criterion 1)
-  icp.setMaximumIterations(5);
-  // // Set the transformation epsilon (criterion 2)
-  // icp.setTransformationEpsilon(1e-8);
-  // // Set the euclidean distance difference epsilon (criterion 3)
-  // icp.setEuclideanFitnessEpsilon(1);
+  initializeAddedObjects(markers);
 
-  icp.setInputTarget(markers);
+  if (m_hasLabels) {
+    bindMarkerLabels();
+  }
+}
 
-  for (auto& object : m_objects) {
-    object.m_lastTransformationValid = false;
+void ObjectTracker::trackObjects(std::chrono::high_resolution_clock::time_point stamp)
+{
+  // objects are independent, so we split them round-robin between threads.
+  // Each thread uses its own scratch space.
+  size_t const nThreads = m_contexts.size();
+  std::function<void(size_t)> const work = [this, nThreads, stamp](size_t t) {
+    TrackingContext& context = *m_contexts[t];
+    for (size_t i = t; i < m_fixedSizeObjects.size(); i += nThreads) {
+      trackObject<4>(context, m_objects[m_fixedSizeObjects[i]], stamp);
+    }
+    for (size_t i = t; i < m_dynamicSizeObjects.size(); i += nThreads) {
+      trackObject<Eigen::Dynamic>(context, m_objects[m_dynamicSizeObjects[i]], stamp);
+    }
+  };
 
-    std::chrono::duration<double> elapsedSeconds = stamp-object.m_lastValidTransform;
-    double dt = elapsedSeconds.count();
+  if (!m_workers) {
+    work(0);
+    return;
+  }
+  m_workers->run(work);
+}
 
-    // Set the max correspondence distance
-    // TODO: take max here?
-    const DynamicsConfiguration& dynConf = m_dynamicsConfigurations[object.m_dynamicsConfigurationIdx];
-    float maxV = dynConf.maxXVelocity;
-    icp.setMaxCorrespondenceDistance(maxV * dt);
-    // ROS_INFO("max: %f", maxV * dt);
+template <int NumMarkers>
+bool ObjectTracker::fitVisibleMarkers(
+  const RigidRegistration<float, NumMarkers>& registration,
+  const Object& object,
+  Eigen::Affine3f& transformation,
+  float& fitness,
+  uint32_t& markersUsed) const
+{
+  typedef RigidRegistration<float, NumMarkers> Registration;
+  const Cloud& model = *m_markerConfigurations[object.m_markerConfigurationIdx];
+  const Eigen::MatrixXf& distances = m_markerConfigurationDistances[object.m_markerConfigurationIdx];
+  int const n = model.size();
+  const auto& correspondences = registration.correspondences();
 
-    // Update input source
-    icp.setInputSource(m_markerConfigurations[object.m_markerConfigurationIdx]);
+  // A matched marker is visible if its distances to the other matched
+  // markers agree with the configuration. Drop the marker with the most
+  // disagreements until all remaining pairs agree.
+  std::vector<bool> visible(n);
+  for (int i = 0; i < n; ++i) {
+    visible[i] = correspondences(i) >= 0;
+  }
+  while (true) {
+    int worst = -1;
+    int worstCount = 0;
+    for (int i = 0; i < n; ++i) {
+      if (!visible[i]) {
+        continue;
+      }
+      int count = 0;
+      for (int j = 0; j < n; ++j) {
+        if (j != i && visible[j]) {
+          float d = (registration.target(correspondences(i)) - registration.target(correspondences(j))).norm();
+          count += std::abs(d - distances(i, j)) > m_visibleMarkerTolerance;
+        }
+      }
+      if (count > worstCount) {
+        worst = i;
+        worstCount = count;
+      }
+    }
+    if (worst < 0) {
+      break;
+    }
+    visible[worst] = false;
+  }
 
-    // Perform the alignment
-    Cloud result;
-    // auto deltaPos = Eigen::Translation3f(dt * object.m_velocity);
-    // auto predictTransform = deltaPos * object.m_lastTransformation;
-    auto predictTransform = object.m_lastTransformation;
-    icp.align(result, predictTransform.matrix());
-    if (!icp.hasConverged()) {
-      // ros::Time t = ros::Time::now();
-      // ROS_INFO("ICP did not converge %d.%d", t.sec, t.nsec);
-      logWarn("ICP did not converge!");
+  int const nVisible = std::count(visible.begin(), visible.end(), true);
+  if (nVisible < std::max<int>(3, m_minVisibleMarkers)) {
+    return false;
+  }
+
+  // refit to the visible markers only
+  typename Registration::ModelMatrix src(3, n);
+  typename Registration::ModelMatrix dst(3, n);
+  typename Registration::WeightVector weights(n);
+  markersUsed = 0;
+  int k = 0;
+  for (int i = 0; i < n; ++i) {
+    if (visible[i]) {
+      src.col(k) = pcl2eig(model[i]);
+      dst.col(k) = registration.target(correspondences(i));
+      weights(k) = 1;
+      ++k;
+      if (i < 32) {
+        markersUsed |= 1u << i;
+      }
+    }
+  }
+  typename Registration::Transform fit =
+    Registration::estimateRigidTransform(src, dst, weights, nVisible);
+
+  float sum = 0;
+  for (int i = 0; i < nVisible; ++i) {
+    sum += (fit * src.col(i) - dst.col(i)).squaredNorm();
+  }
+  fitness = sum / nVisible;
+  transformation = fit;
+  return true;
+}
+
+void ObjectTracker::updateKernelBuckets()
+{
+  m_fixedSizeObjects.clear();
+  m_dynamicSizeObjects.clear();
+  for (size_t i = 0; i < m_objects.size(); ++i) {
+    // removed objects may refer to configurations that no longer exist
+    if (!m_objects[i].m_active) {
       continue;
     }
+    if (m_markerConfigurations[m_objects[i].m_markerConfigurationIdx]->size() == 4) {
+      m_fixedSizeObjects.push_back(i);
+    } else {
+      m_dynamicSizeObjects.push_back(i);
+    }
+  }
+}
 
-    // Obtain the transformation that aligned cloud_source to cloud_source_registered
-    Eigen::Matrix4f transformation = icp.getFinalTransformation();
+void ObjectTracker::updateParticleFilters()
+{
+  for (auto& object : m_objects) {
+    auto& filter = object.m_particleFilter;
+    size_t const numParticles = object.m_active
+      ? m_dynamicsConfigurations[object.m_dynamicsConfigurationIdx].numParticles : 0;
+    if (numParticles == 0) {
+      filter.reset();
+      continue;
+    }
+    if (!filter || filter->size() != std::min<size_t>(numParticles, ParticleFilter::MaxParticles)) {
+      filter.reset(new ParticleFilter(numParticles));
+      filter->reset(object.m_lastTransformation, object.m_lastPoseChange);
+    }
+  }
+}
 
-    Eigen::Affine3f tROTA(transformation);
-    float x, y, z, roll, pitch, yaw;
-    pcl::getTranslationAndEulerAngles(tROTA, x, y, z, roll, pitch, yaw);
+void ObjectTracker::initializeAddedObjects(Cloud::ConstPtr markers)
+{
+  std::vector<size_t> objectIndices;
+  for (size_t i = 0; i < m_objects.size(); ++i) {
+    if (m_objects[i].m_active && m_objects[i].m_awaitingInitialization) {
+      objectIndices.push_back(i);
+    }
+  }
+  if (objectIndices.empty()) {
+    return;
+  }
 
-    // Compute changes:
-    float last_x, last_y, last_z, last_roll, last_pitch, last_yaw;
-    pcl::getTranslationAndEulerAngles(object.m_lastTransformation, last_x, last_y, last_z, last_roll, last_pitch, last_yaw);
+  // markers explained by a tracked object are not available to the new ones;
+  // a marker farther from the tracked pose than a new object may deviate
+  // from its initial position is left to the new objects
+  float const maxDeviation = maxInitializationDeviation(objectIndices);
+  float const maxSqrDeviation = maxDeviation * maxDeviation;
+  pcl::KdTreeFLANN<Point> kdtree;
+  kdtree.setInputCloud(markers);
+  std::vector<int> nearestIdx(1);
+  std::vector<float> nearestSqrDist(1);
+  std::vector<bool> taken(markers->size(), false);
+  for (const auto& object : m_objects) {
+    if (!object.m_lastTransformationValid) {
+      continue;
+    }
+    for (const auto& p : *m_markerConfigurations[object.m_markerConfigurationIdx]) {
+      Point predicted = eig2pcl(object.m_lastTransformation * pcl2eig(p));
+      if (kdtree.nearestKSearch(predicted, 1, nearestIdx, nearestSqrDist) == 1
+          && nearestSqrDist[0] <= maxSqrDeviation) {
+        taken[nearestIdx[0]] = true;
+      }
+    }
+  }
+  Cloud::Ptr available(new Cloud);
+  available->reserve(markers->size());
+  for (size_t i = 0; i < markers->size(); ++i) {
+    if (!taken[i]) {
+      available->push_back((*markers)[i]);
+    }
+  }
 
-    float vx = (x - last_x) / dt;
-    float vy = (y - last_y) / dt;
-    float vz = (z - last_z) / dt;
-    float wroll = deltaAngle(roll, last_roll) / dt;
-    float wpitch = deltaAngle(pitch, last_pitch) / dt;
-    float wyaw = deltaAngle(yaw, last_yaw) / dt;
+  bool success = initialize(available, objectIndices);
+  m_initializationFailed = m_initializationFailed || !success;
+  if (m_metrics) {
+    m_metrics->recordInitialization(success);
+  }
+}
 
-    // ROS_INFO("v: %f,%f,%f, w: %f,%f,%f, dt: %f", vx, vy, vz, wroll, wpitch, wyaw, dt);
+template <int NumMarkers>
+void ObjectTracker::trackObject(TrackingContext& context, Object& object,
+  std::chrono::high_resolution_clock::time_point stamp)
+{
+  bool const wasValid = object.m_lastTransformationValid;
+  object.m_lastTransformationValid = false;
+  object.m_trackedByLabels = false;
+  if (!object.m_active || object.m_awaitingInitialization) {
+    return;
+  }
 
-    if (   fabs(vx) < dynConf.maxXVelocity
-        && fabs(vy) < dynConf.maxYVelocity
-        && fabs(vz) < dynConf.maxZVelocity
-        && fabs(wroll) < dynConf.maxRollRate
-        && fabs(wpitch) < dynConf.maxPitchRate
-        && fabs(wyaw) < dynConf.maxYawRate
-        && fabs(roll) < dynConf.maxRoll
-        && fabs(pitch) < dynConf.maxPitch
-        && icp.getFitnessScore() < dynConf.maxFitnessScore)
-    {
-      object.m_velocity = (tROTA.translation() - object.center()) / dt;
-      object.m_lastTransformation = tROTA;
-      object.m_lastValidTransform = stamp;
-      object.m_lastTransformationValid = true;
+  // the first pose after restoreState is compared to a pose that was
+  // extrapolated over the restart gap, so the velocity it implies is
+  // meaningless; the persisted one is kept instead
+  if (object.m_velocityRestored) {
+    Eigen::Vector3f const velocity = object.m_velocity;
+    object.m_velocityRestored = false;
+    object.m_lastTransformationValid = wasValid;
+    trackObject<NumMarkers>(context, object, stamp);
+    if (object.m_lastTransformationValid) {
+      object.m_velocity = velocity;
     } else {
-      std::stringstream sstr;
-      sstr << "Dynamic check failed" << std::endl;
-      if (fabs(vx) >= dynConf.maxXVelocity) {
-        sstr << "vx: " << vx << " >= " << dynConf.maxXVelocity << std::endl;
-      }
-      if (fabs(vy) >= dynConf.maxYVelocity) {
-        sstr << "vy: " << vy << " >= " << dynConf.maxYVelocity << std::endl;
-      }
-      if (fabs(vz) >= dynConf.maxZVelocity) {
-        sstr << "vz: " << vz << " >= " << dynConf.maxZVelocity << std::endl;
+      object.m_velocityRestored = !object.m_awaitingInitialization;
+    }
+    return;
+  }
+
+  // since the pose was last computed; stationary frames do not count
+  std::chrono::duration<double> elapsedSeconds = stamp-object.m_lastPoseChange;
+  double dt = elapsedSeconds.count();
+
+  const DynamicsConfiguration& dynConf = m_dynamicsConfigurations[object.m_dynamicsConfigurationIdx];
+  const Cloud::Ptr& objMarkers = m_markerConfigurations[object.m_markerConfigurationIdx];
+
+  if (m_hasLabels && trackLabeledMarkers<NumMarkers>(object, stamp, dt)) {
+    object.m_trackedByLabels = true;
+    return;
+  }
+
+  // If every predicted marker has a frame marker within a tiny residual,
+  // the object did not move and the last pose is confirmed as is.
+  // Any deviation falls through to the full registration below.
+  if (wasValid && m_stationaryThreshold > 0) {
+    bool stationary = true;
+    for (auto const &p : *objMarkers) {
+      Eigen::Vector3f predicted = object.m_lastTransformation * pcl2eig(p);
+      if (context.kdtree->radiusSearch(eig2pcl(predicted), m_stationaryThreshold,
+            context.nearestIdx, context.nearestSqrDist, 1) == 0) {
+        stationary = false;
+        break;
       }
-      if (fabs(wroll) >= dynConf.maxRollRate) {
-        sstr << "wroll: " << wroll << " >= " << dynConf.maxRollRate << std::endl;
+    }
+    if (stationary) {
+      object.m_markersUsed = objMarkers->size() >= 32 ? ~0u : (1u << objMarkers->size()) - 1;
+      // the pose and its stamp are kept, so the next registration
+      // measures the velocity over the whole time the object was held.
+      // Meanwhile, it moved less than the threshold since then.
+      float const maxSpeed = m_stationaryThreshold / std::max(dt, 1e-6);
+      if (object.m_velocity.norm() > maxSpeed) {
+        object.m_velocity *= maxSpeed / object.m_velocity.norm();
       }
-      if (fabs(wpitch) >= dynConf.maxPitchRate) {
-        sstr << "wpitch: " << wpitch << " >= " << dynConf.maxPitchRate << std::endl;
+      object.m_lastValidTransform = stamp;
+      object.m_lastTransformationValid = true;
+      object.m_history.append(stamp, object.m_lastTransformation);
+      return;
+    }
+  }
+
+  if (wasValid && m_markerAssociationGate > 0 && dynConf.numParticles == 0
+      && (m_markerConfigurationSymmetries.empty()
+        || m_markerConfigurationSymmetries[object.m_markerConfigurationIdx].empty())
+      && trackAssociatedMarkers<NumMarkers>(context, object, stamp, dt)) {
+    return;
+  }
+
+  // Each marker can move at most by the velocity limits per axis, plus the
+  // sweep of the object's radius under the rotation rate limits
+  // (yaw moves markers within the xy plane only).
+  // After dropouts, the gate stops growing at m_maxGatingInterval.
+  float const gateDt = std::min<float>(dt, m_maxGatingInterval);
+  float const radius = m_markerConfigurationRadii[object.m_markerConfigurationIdx];
+  float const maxTiltRate = std::max(dynConf.maxRollRate, dynConf.maxPitchRate);
+  float const maxRate = std::max<float>(maxTiltRate, dynConf.maxYawRate);
+  float const sweepXY = radius * std::min<float>(maxRate * gateDt, 2);
+  float const sweepZ = radius * std::min<float>(maxTiltRate * gateDt, 2);
+  Eigen::Array3f const gate(
+    dynConf.maxXVelocity * gateDt + sweepXY,
+    dynConf.maxYVelocity * gateDt + sweepXY,
+    dynConf.maxZVelocity * gateDt + sweepZ);
+  float const maxGate = gate.maxCoeff();
+
+  // collect the frame markers within the ellipsoidal gate
+  // around any of the object's predicted marker positions
+  context.candidates.clear();
+  for (auto const &p : *objMarkers) {
+    Eigen::Vector3f predicted = object.m_lastTransformation * pcl2eig(p);
+    context.kdtree->radiusSearch(eig2pcl(predicted), maxGate,
+      context.nearestIdx, context.nearestSqrDist);
+    for (int idx : context.nearestIdx) {
+      Eigen::Array3f d = (pcl2eig((*context.markers)[idx]) - predicted).array() / gate;
+      if (d.square().sum() <= 1) {
+        context.candidates.push_back(idx);
       }
-      if (fabs(wyaw) >= dynConf.maxYawRate) {
-        sstr << "wyaw: " << wyaw << " >= " << dynConf.maxYawRate << std::endl;
+    }
+  }
+  std::sort(context.candidates.begin(), context.candidates.end());
+  context.candidates.erase(
+    std::unique(context.candidates.begin(), context.candidates.end()),
+    context.candidates.end());
+
+  context.gated->clear();
+  for (int idx : context.candidates) {
+    context.gated->push_back((*context.markers)[idx]);
+  }
+
+  if (dynConf.numParticles > 0) {
+    trackParticles(context, object, stamp, dt);
+    return;
+  }
+
+  // ICP needs at least 3 correspondences
+  if (context.candidates.size() < 3) {
+    logWarn("Not enough markers within correspondence gate!");
+    return;
+  }
+
+  RigidRegistration<float, NumMarkers> registration;
+  registration.setModel(*objMarkers);
+  registration.setTarget(*context.gated);
+  registration.setMaxCorrespondenceDistance(maxGate);
+  registration.setMaximumIterations(5);
+  registration.setRobustLoss(m_robustLoss, m_robustLossParameter);
+
+  if (!m_markerConfigurationSymmetries.empty()
+      && !m_markerConfigurationSymmetries[object.m_markerConfigurationIdx].empty()) {
+    trackHypotheses(registration, object, stamp, dt);
+    return;
+  }
+
+  // Perform the alignment
+  // auto deltaPos = Eigen::Translation3f(dt * object.m_velocity);
+  // auto predictTransform = deltaPos * object.m_lastTransformation;
+  auto predictTransform = object.m_lastTransformation;
+  if (!registration.align(predictTransform)) {
+    logWarn("ICP did not converge!");
+    return;
+  }
+  float fitness = registration.fitnessScore();
+  Eigen::Affine3f tROTA = registration.transformation();
+  uint32_t markersUsed = objMarkers->size() >= 32 ? ~0u : (1u << objMarkers->size()) - 1;
+
+  if (m_minVisibleMarkers > 0 && m_minVisibleMarkers < objMarkers->size()) {
+    if (!fitVisibleMarkers(registration, object, tROTA, fitness, markersUsed)) {
+      logWarn("Not enough visible markers!");
+      return;
+    }
+  }
+  std::string failure;
+  if (checkDynamics(dynConf, object.m_lastTransformation, tROTA, dt, fitness, &failure)) {
+    object.m_velocity = (tROTA.translation() - object.center()) / dt;
+    object.m_lastTransformation = tROTA;
+    object.m_lastValidTransform = stamp;
+    object.m_lastPoseChange = stamp;
+    object.m_lastTransformationValid = true;
+    object.m_markersUsed = markersUsed;
+    object.m_history.append(stamp, tROTA);
+  } else {
+    logWarn(failure);
+  }
+}
+
+template <int NumMarkers>
+bool ObjectTracker::trackAssociatedMarkers(TrackingContext& context, Object& object,
+  std::chrono::high_resolution_clock::time_point stamp,
+  double dt)
+{
+  typedef RigidRegistration<float, NumMarkers> Registration;
+  const DynamicsConfiguration& dynConf = m_dynamicsConfigurations[object.m_dynamicsConfigurationIdx];
+  const Cloud& model = *m_markerConfigurations[object.m_markerConfigurationIdx];
+  int const n = model.size();
+  int const required = (m_minVisibleMarkers > 0 && m_minVisibleMarkers < model.size())
+    ? std::max<int>(3, m_minVisibleMarkers) : n;
+
+  // one lookup per model marker; a second marker within the gate
+  // makes the association ambiguous
+  Eigen::Affine3f const predicted = Eigen::Translation3f(
+    object.m_velocity * std::min<float>(dt, m_maxGatingInterval)) * object.m_lastTransformation;
+  context.associated.assign(n, -1);
+  int matched = 0;
+  for (int i = 0; i < n; ++i) {
+    int const found = context.kdtree->radiusSearch(eig2pcl(predicted * pcl2eig(model[i])),
+      m_markerAssociationGate, context.nearestIdx, context.nearestSqrDist, 2);
+    if (found > 1) {
+      return false;
+    }
+    if (found == 1) {
+      int const idx = context.nearestIdx[0];
+      for (int j = 0; j < i; ++j) {
+        if (context.associated[j] == idx) {
+          return false;
+        }
       }
-      if (fabs(roll) >= dynConf.maxRoll) {
-        sstr << "roll: " << roll << " >= " << dynConf.maxRoll << std::endl;
+      context.associated[i] = idx;
+      ++matched;
+    }
+  }
+  if (matched < required) {
+    return false;
+  }
+
+  typename Registration::ModelMatrix src(3, n);
+  typename Registration::ModelMatrix dst(3, n);
+  typename Registration::WeightVector weights(n);
+  uint32_t markersUsed = 0;
+  int k = 0;
+  for (int i = 0; i < n; ++i) {
+    if (context.associated[i] >= 0) {
+      src.col(k) = pcl2eig(model[i]);
+      dst.col(k) = pcl2eig((*context.markers)[context.associated[i]]);
+      weights(k) = 1;
+      ++k;
+      if (i < 32) {
+        markersUsed |= 1u << i;
       }
-      if (fabs(pitch) >= dynConf.maxPitch) {
-        sstr << "pitch: " << pitch << " >= " << dynConf.maxPitch << std::endl;
+    }
+  }
+  typename Registration::Transform const fit =
+    Registration::estimateRigidTransform(src, dst, weights, matched);
+
+  float const maxSqrResidual = m_markerAssociationGate * m_markerAssociationGate;
+  float sum = 0;
+  for (int i = 0; i < matched; ++i) {
+    float const r = (fit * src.col(i) - dst.col(i)).squaredNorm();
+    if (r > maxSqrResidual) {
+      return false;
+    }
+    sum += r;
+  }
+  float const fitness = sum / matched;
+  Eigen::Affine3f const transformation = fit;
+  if (!checkDynamics(dynConf, object.m_lastTransformation, transformation, dt, fitness, nullptr)) {
+    return false;
+  }
+
+  object.m_velocity = (transformation.translation() - object.center()) / dt;
+  object.m_lastTransformation = transformation;
+  object.m_lastValidTransform = stamp;
+  object.m_lastPoseChange = stamp;
+  object.m_lastTransformationValid = true;
+  object.m_markersUsed = markersUsed;
+  object.m_history.append(stamp, transformation);
+  return true;
+}
+
+template <int NumMarkers>
+bool ObjectTracker::trackLabeledMarkers(Object& object,
+  std::chrono::high_resolution_clock::time_point stamp,
+  double dt)
+{
+  typedef RigidRegistration<float, NumMarkers> Registration;
+  const DynamicsConfiguration& dynConf = m_dynamicsConfigurations[object.m_dynamicsConfigurationIdx];
+  const Cloud& model = *m_markerConfigurations[object.m_markerConfigurationIdx];
+  int const n = model.size();
+  // bindings of a previous configuration
+  if (object.m_markerLabels.size() != model.size()) {
+    return false;
+  }
+  int const required = (m_minVisibleMarkers > 0 && m_minVisibleMarkers < model.size())
+    ? std::max<int>(3, m_minVisibleMarkers) : n;
+
+  typename Registration::ModelMatrix src(3, n);
+  typename Registration::ModelMatrix dst(3, n);
+  typename Registration::WeightVector weights(n);
+  uint32_t markersUsed = 0;
+  int matched = 0;
+  for (int i = 0; i < n; ++i) {
+    int const idx = labeledMarker(object.m_markerLabels[i]);
+    if (idx < 0) {
+      continue;
+    }
+    src.col(matched) = pcl2eig(model[i]);
+    dst.col(matched) = pcl2eig((*m_labeledMarkers)[idx]);
+    weights(matched) = 1;
+    ++matched;
+    if (i < 32) {
+      markersUsed |= 1u << i;
+    }
+  }
+  if (matched < required) {
+    return false;
+  }
+  typename Registration::Transform const fit =
+    Registration::estimateRigidTransform(src, dst, weights, matched);
+
+  // a label that moved to another marker does not fit the configuration
+  float const maxSqrResidual = m_markerLabelTolerance * m_markerLabelTolerance;
+  float sum = 0;
+  for (int i = 0; i < matched; ++i) {
+    float const r = (fit * src.col(i) - dst.col(i)).squaredNorm();
+    if (r > maxSqrResidual) {
+      return false;
+    }
+    sum += r;
+  }
+  float const fitness = sum / matched;
+  Eigen::Affine3f const transformation = fit;
+  if (!checkDynamics(dynConf, object.m_lastTransformation, transformation, dt, fitness, nullptr)) {
+    return false;
+  }
+
+  object.m_velocity = (transformation.translation() - object.center()) / dt;
+  object.m_lastTransformation = transformation;
+  object.m_lastValidTransform = stamp;
+  object.m_lastPoseChange = stamp;
+  object.m_lastTransformationValid = true;
+  object.m_markersUsed = markersUsed;
+  object.m_history.append(stamp, transformation);
+  return true;
+}
+
+void ObjectTracker::bindMarkerLabels()
+{
+  bool needed = false;
+  for (const auto& object : m_objects) {
+    needed = needed || (object.m_lastTransformationValid && !object.m_trackedByLabels);
+  }
+  if (!needed || m_labeledMarkers->empty()) {
+    return;
+  }
+
+  pcl::KdTreeFLANN<Point> kdtree;
+  kdtree.setInputCloud(m_labeledMarkers);
+  std::vector<int> nearestIdx(1);
+  std::vector<float> nearestSqrDist(1);
+  float const maxSqrDist = m_markerLabelTolerance * m_markerLabelTolerance;
+  for (auto& object : m_objects) {
+    if (!object.m_lastTransformationValid || object.m_trackedByLabels) {
+      continue;
+    }
+    const Cloud& model = *m_markerConfigurations[object.m_markerConfigurationIdx];
+    auto& labels = object.m_markerLabels;
+    labels.assign(model.size(), Object::NoLabel);
+    for (size_t i = 0; i < model.size(); ++i) {
+      Point predicted = eig2pcl(object.m_lastTransformation * pcl2eig(model[i]));
+      if (kdtree.nearestKSearch(predicted, 1, nearestIdx, nearestSqrDist) != 1
+          || nearestSqrDist[0] > maxSqrDist) {
+        continue;
       }
-      if (icp.getFitnessScore() >= dynConf.maxFitnessScore) {
-        sstr << "fitness: " << icp.getFitnessScore() << " >= " << dynConf.maxFitnessScore << std::endl;
+      uint32_t const label = m_frameLabels[nearestIdx[0]];
+      if (labeledMarker(label) >= 0
+          && std::find(labels.begin(), labels.end(), label) == labels.end()) {
+        labels[i] = label;
       }
-      logWarn(sstr.str());
     }
   }
+}
+
+template <int NumMarkers>
+void ObjectTracker::trackHypotheses(RigidRegistration<float, NumMarkers>& registration,
+  Object& object,
+  std::chrono::high_resolution_clock::time_point stamp,
+  double dt)
+{
+  // weight of the previous cost per frame
+  static float const CostDecay = 0.9;
+  // another hypothesis is reported once its cost is below this
+  // fraction of the reported one's
+  static float const SwitchRatio = 0.5;
+
+  const DynamicsConfiguration& dynConf = m_dynamicsConfigurations[object.m_dynamicsConfigurationIdx];
+  const MarkerConfigurationSymmetries& symmetries =
+    m_markerConfigurationSymmetries[object.m_markerConfigurationIdx];
+  size_t const numMarkers = m_markerConfigurations[object.m_markerConfigurationIdx]->size();
+  auto& hypotheses = object.m_hypotheses;
+
+  // the pose was set elsewhere (initialization, restored state)
+  if (hypotheses.empty() || !hypotheses[0].transformation.isApprox(object.m_lastTransformation)) {
+    PoseHypothesis h = {object.m_lastTransformation, 0, object.m_markersUsed};
+    hypotheses.assign(1, h);
+  }
 
+  // register every hypothesis; a hypothesis survives if its new pose
+  // is reachable from its own last pose and not a duplicate
+  size_t kept = 0;
+  for (size_t i = 0; i < hypotheses.size(); ++i) {
+    const PoseHypothesis& h = hypotheses[i];
+    if (!registration.align(h.transformation)) {
+      continue;
+    }
+    float fitness = registration.fitnessScore();
+    Eigen::Affine3f t = registration.transformation();
+    uint32_t markersUsed = numMarkers >= 32 ? ~0u : (1u << numMarkers) - 1;
+    if (m_minVisibleMarkers > 0 && m_minVisibleMarkers < numMarkers
+        && !fitVisibleMarkers(registration, object, t, fitness, markersUsed)) {
+      continue;
+    }
+    if (!checkDynamics(dynConf, h.transformation, t, dt, fitness, nullptr)) {
+      continue;
+    }
+    bool duplicate = false;
+    for (size_t k = 0; k < kept && !duplicate; ++k) {
+      duplicate = samePose(hypotheses[k].transformation, t);
+    }
+    if (duplicate) {
+      continue;
+    }
+    PoseHypothesis& out = hypotheses[kept++];
+    out.cost = CostDecay * h.cost + fitness;
+    out.transformation = t;
+    out.markersUsed = markersUsed;
+  }
+  hypotheses.resize(kept);
+  if (hypotheses.empty()) {
+    logWarn("No pose hypothesis passed the dynamics check!");
+    return;
+  }
+
+  // exactly symmetric configurations give equal costs,
+  // so the reported pose only changes on clear evidence
+  size_t best = 0;
+  for (size_t k = 1; k < hypotheses.size(); ++k) {
+    if (hypotheses[k].cost < hypotheses[best].cost) {
+      best = k;
+    }
+  }
+  if (best != 0 && hypotheses[best].cost < SwitchRatio * hypotheses[0].cost) {
+    std::swap(hypotheses[0], hypotheses[best]);
+  }
+  PoseHypothesis const primary = hypotheses[0];
+
+  // the symmetric counterparts of the reported pose are always considered
+  for (const auto& symmetry : symmetries) {
+    if (hypotheses.size() >= m_maxPoseHypotheses) {
+      break;
+    }
+    Eigen::Affine3f const t = primary.transformation * symmetry;
+    bool known = false;
+    for (size_t k = 0; k < hypotheses.size() && !known; ++k) {
+      known = samePose(hypotheses[k].transformation, t);
+    }
+    if (!known) {
+      PoseHypothesis h = {t, primary.cost, primary.markersUsed};
+      hypotheses.push_back(h);
+    }
+  }
+
+  object.m_velocity = (primary.transformation.translation() - object.center()) / dt;
+  object.m_lastTransformation = primary.transformation;
+  object.m_lastValidTransform = stamp;
+  object.m_lastPoseChange = stamp;
+  object.m_lastTransformationValid = true;
+  object.m_markersUsed = primary.markersUsed;
+  object.m_history.append(stamp, primary.transformation);
+}
+
+void ObjectTracker::trackParticles(TrackingContext& context, Object& object,
+  std::chrono::high_resolution_clock::time_point stamp,
+  double dt)
+{
+  const DynamicsConfiguration& dynConf = m_dynamicsConfigurations[object.m_dynamicsConfigurationIdx];
+  const Cloud& model = *m_markerConfigurations[object.m_markerConfigurationIdx];
+  if (context.gated->empty()) {
+    logWarn("No markers within correspondence gate!");
+    return;
+  }
+
+  // The filter (created by updateParticleFilters) restarts from the
+  // object's pose if the pose was set elsewhere (initialization,
+  // restored state, a failed dynamics check). Objects that never had a
+  // valid pose start without motion.
+  auto& filter = object.m_particleFilter;
+  if (!filter->estimate().isApprox(object.m_lastTransformation)) {
+    bool const everValid = object.m_lastPoseChange != std::chrono::high_resolution_clock::time_point();
+    filter->reset(object.m_lastTransformation, everValid ? object.m_lastPoseChange : stamp);
+  }
+
+  float fitness;
+  uint32_t markersUsed;
+  if (filter->update(model, *context.gated, object.m_velocity, dynConf,
+        stamp, m_maxGatingInterval, fitness, markersUsed) == 0) {
+    logWarn("No marker matches the particle filter's estimate!");
+    return;
+  }
+  Eigen::Affine3f const estimate = filter->estimate();
+
+  std::string failure;
+  if (!checkDynamics(dynConf, object.m_lastTransformation, estimate, dt, fitness, &failure)) {
+    logWarn(failure);
+    return;
+  }
+  object.m_velocity = (estimate.translation() - object.center()) / dt;
+  object.m_lastTransformation = estimate;
+  object.m_lastValidTransform = stamp;
+  object.m_lastPoseChange = stamp;
+  object.m_lastTransformationValid = true;
+  object.m_markersUsed = markersUsed;
+  object.m_history.append(stamp, estimate);
+}
+
+bool checkDynamics(const DynamicsConfiguration& dynConf,
+  const Eigen::Affine3f& last,
+  const Eigen::Affine3f& next,
+  double dt,
+  float fitness,
+  std::string* failure)
+{
+  float x, y, z, roll, pitch, yaw;
+  pcl::getTranslationAndEulerAngles(next, x, y, z, roll, pitch, yaw);
+
+  // Compute changes:
+  float last_x, last_y, last_z, last_roll, last_pitch, last_yaw;
+  pcl::getTranslationAndEulerAngles(last, last_x, last_y, last_z, last_roll, last_pitch, last_yaw);
+
+  float vx = (x - last_x) / dt;
+  float vy = (y - last_y) / dt;
+  float vz = (z - last_z) / dt;
+  float wroll = deltaAngle(roll, last_roll) / dt;
+  float wpitch = deltaAngle(pitch, last_pitch) / dt;
+  float wyaw = deltaAngle(yaw, last_yaw) / dt;
+
+  // ROS_INFO("v: %f,%f,%f, w: %f,%f,%f, dt: %f", vx, vy, vz, wroll, wpitch, wyaw, dt);
+
+  if (   fabs(vx) < dynConf.maxXVelocity
+      && fabs(vy) < dynConf.maxYVelocity
+      && fabs(vz) < dynConf.maxZVelocity
+      && fabs(wroll) < dynConf.maxRollRate
+      && fabs(wpitch) < dynConf.maxPitchRate
+      && fabs(wyaw) < dynConf.maxYawRate
+      && fabs(roll) < dynConf.maxRoll
+      && fabs(pitch) < dynConf.maxPitch
+      && fitness < dynConf.maxFitnessScore)
+  {
+    return true;
+  }
+  if (!failure) {
+    return false;
+  }
+
+  std::stringstream sstr;
+  sstr << "Dynamic check failed" << std::endl;
+  if (fabs(vx) >= dynConf.maxXVelocity) {
+    sstr << "vx: " << vx << " >= " << dynConf.maxXVelocity << std::endl;
+  }
+  if (fabs(vy) >= dynConf.maxYVelocity) {
+    sstr << "vy: " << vy << " >= " << dynConf.maxYVelocity << std::endl;
+  }
+  if (fabs(vz) >= dynConf.maxZVelocity) {
+    sstr << "vz: " << vz << " >= " << dynConf.maxZVelocity << std::endl;
+  }
+  if (fabs(wroll) >= dynConf.maxRollRate) {
+    sstr << "wroll: " << wroll << " >= " << dynConf.maxRollRate << std::endl;
+  }
+  if (fabs(wpitch) >= dynConf.maxPitchRate) {
+    sstr << "wpitch: " << wpitch << " >= " << dynConf.maxPitchRate << std::endl;
+  }
+  if (fabs(wyaw) >= dynConf.maxYawRate) {
+    sstr << "wyaw: " << wyaw << " >= " << dynConf.maxYawRate << std::endl;
+  }
+  if (fabs(roll) >= dynConf.maxRoll) {
+    sstr << "roll: " << roll << " >= " << dynConf.maxRoll << std::endl;
+  }
+  if (fabs(pitch) >= dynConf.maxPitch) {
+    sstr << "pitch: " << pitch << " >= " << dynConf.maxPitch << std::endl;
+  }
+  if (fitness >= dynConf.maxFitnessScore) {
+    sstr << "fitness: " << fitness << " >= " << dynConf.maxFitnessScore << std::endl;
+  }
+  *failure = sstr.str();
+  return false;
 }
 
 void ObjectTracker::logWarn(const std::string& msg)
 {
+  if (m_metrics) {
+    m_metrics->recordWarning();
+  }
+  // objects may be tracked from several threads
+  std::lock_guard<std::mutex> lock(m_logWarnMutex);
   if (m_logWarn) {
     m_logWarn(msg);
   }
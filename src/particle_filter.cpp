@@ -0,0 +1,256 @@
+#include "libobjecttracker/particle_filter.h"
+#include "libobjecttracker/object_tracker.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace libobjecttracker {
+
+const size_t ParticleFilter::MaxParticles;
+
+// grids larger than this get coarser cells instead
+static int const MaxGridCells = 1 << 15;
+
+ParticleFilter::ParticleFilter(size_t numParticles, float markerSigma)
+  : m_markerSigma(markerSigma)
+  , m_cutoff(3 * markerSigma)
+  , m_x(std::max<size_t>(1, std::min(numParticles, MaxParticles)))
+  , m_estimate(Eigen::Affine3f::Identity())
+  , m_stamp()
+  , m_random(42)
+  , m_cellSize(3 * markerSigma)
+  , m_gridOrigin(0, 0, 0)
+  , m_gridSize(0, 0, 0)
+{
+  Eigen::Index const n = m_x.size();
+  for (auto* a : {&m_y, &m_z, &m_qx, &m_qy, &m_qz, &m_qw, &m_logWeights, &m_weights}) {
+    a->resize(n);
+  }
+  reset(m_estimate, m_stamp);
+}
+
+void ParticleFilter::reset(const Eigen::Affine3f& pose,
+  std::chrono::high_resolution_clock::time_point stamp)
+{
+  Eigen::Vector3f const t = pose.translation();
+  Eigen::Quaternionf const q(pose.rotation());
+  m_x.setConstant(t.x());
+  m_y.setConstant(t.y());
+  m_z.setConstant(t.z());
+  m_qx.setConstant(q.x());
+  m_qy.setConstant(q.y());
+  m_qz.setConstant(q.z());
+  m_qw.setConstant(q.w());
+  m_weights.setConstant(1.0f / size());
+  m_estimate = pose;
+  m_stamp = stamp;
+}
+
+void ParticleFilter::buildGrid(const pcl::PointCloud<pcl::PointXYZ>& markers)
+{
+  m_gridMarkers.clear();
+  m_cellStart.clear();
+  if (markers.empty()) {
+    return;
+  }
+
+  Eigen::Vector3f min = markers[0].getVector3fMap();
+  Eigen::Vector3f max = min;
+  for (const auto& p : markers) {
+    min = min.cwiseMin(p.getVector3fMap());
+    max = max.cwiseMax(p.getVector3fMap());
+  }
+  // cells are at least as large as the cutoff, so the neighboring
+  // cells hold all markers within it
+  float cell = m_cutoff;
+  m_gridOrigin = min.array() - cell;
+  Eigen::Array3f extent = (max - min).array() + 2 * cell;
+  while (((extent / cell).ceil().prod()) > MaxGridCells) {
+    cell *= 2;
+    m_gridOrigin = min.array() - cell;
+    extent = (max - min).array() + 2 * cell;
+  }
+  m_cellSize = cell;
+  m_gridSize = (extent / cell).ceil().cast<int>().max(1).matrix();
+
+  // counting sort of the markers by cell
+  int const numCells = m_gridSize.prod();
+  m_cellStart.assign(numCells + 1, 0);
+  m_markerCells.resize(markers.size());
+  for (size_t i = 0; i < markers.size(); ++i) {
+    Eigen::Vector3i c = ((markers[i].getVector3fMap() - m_gridOrigin) / cell)
+      .array().floor().cast<int>().min(m_gridSize.array() - 1).matrix();
+    m_markerCells[i] = (c.z() * m_gridSize.y() + c.y()) * m_gridSize.x() + c.x();
+    ++m_cellStart[m_markerCells[i] + 1];
+  }
+  for (int c = 0; c < numCells; ++c) {
+    m_cellStart[c + 1] += m_cellStart[c];
+  }
+  m_gridMarkers.resize(markers.size());
+  m_cellFill.assign(m_cellStart.begin(), m_cellStart.end() - 1);
+  for (size_t i = 0; i < markers.size(); ++i) {
+    m_gridMarkers[m_cellFill[m_markerCells[i]]++] = markers[i].getVector3fMap();
+  }
+}
+
+float ParticleFilter::nearestSqrDist(const Eigen::Vector3f& p) const
+{
+  Eigen::Vector3f const g = (p - m_gridOrigin) / m_cellSize;
+  int const cx = std::floor(g.x());
+  int const cy = std::floor(g.y());
+  int const cz = std::floor(g.z());
+  float best = m_cutoff * m_cutoff;
+  bool found = false;
+  for (int z = std::max(cz - 1, 0); z <= std::min(cz + 1, m_gridSize.z() - 1); ++z) {
+    for (int y = std::max(cy - 1, 0); y <= std::min(cy + 1, m_gridSize.y() - 1); ++y) {
+      for (int x = std::max(cx - 1, 0); x <= std::min(cx + 1, m_gridSize.x() - 1); ++x) {
+        int const c = (z * m_gridSize.y() + y) * m_gridSize.x() + x;
+        for (int i = m_cellStart[c]; i < m_cellStart[c + 1]; ++i) {
+          float const d = (m_gridMarkers[i] - p).squaredNorm();
+          if (d <= best) {
+            best = d;
+            found = true;
+          }
+        }
+      }
+    }
+  }
+  return found ? best : -1;
+}
+
+size_t ParticleFilter::update(const pcl::PointCloud<pcl::PointXYZ>& model,
+  const pcl::PointCloud<pcl::PointXYZ>& markers,
+  const Eigen::Vector3f& velocity,
+  const DynamicsConfiguration& dynConf,
+  std::chrono::high_resolution_clock::time_point stamp,
+  float maxInterval,
+  float& fitness,
+  uint32_t& markersUsed)
+{
+  if (markers.empty()) {
+    return 0;
+  }
+  std::chrono::duration<float> const elapsed = stamp - m_stamp;
+  float const dt = std::max(0.0f, std::min(elapsed.count(), maxInterval));
+  m_stamp = stamp;
+
+  Eigen::Index const n = size();
+  std::normal_distribution<float> normal;
+  auto noise = [&](Array& a, float sigma) {
+    for (Eigen::Index i = 0; i < n; ++i) {
+      a[i] = sigma * normal(m_random);
+    }
+  };
+
+  // motion: constant velocity plus noise within the dynamics limits
+  m_scratch.resize(n);
+  noise(m_scratch, dynConf.maxXVelocity * dt / 3);
+  m_x += velocity.x() * dt + m_scratch;
+  noise(m_scratch, dynConf.maxYVelocity * dt / 3);
+  m_y += velocity.y() * dt + m_scratch;
+  noise(m_scratch, dynConf.maxZVelocity * dt / 3);
+  m_z += velocity.z() * dt + m_scratch;
+
+  // q * (1, d/2), d a small rotation in the body frame
+  Array dx(n), dy(n), dz(n);
+  noise(dx, dynConf.maxRollRate * dt / 6);
+  noise(dy, dynConf.maxPitchRate * dt / 6);
+  noise(dz, dynConf.maxYawRate * dt / 6);
+  Array const qw = m_qw - m_qx * dx - m_qy * dy - m_qz * dz;
+  Array const qx = m_qx + m_qw * dx + m_qy * dz - m_qz * dy;
+  Array const qy = m_qy + m_qw * dy + m_qz * dx - m_qx * dz;
+  Array const qz = m_qz + m_qw * dz + m_qx * dy - m_qy * dx;
+  Array const norm = (qw.square() + qx.square() + qy.square() + qz.square()).sqrt();
+  m_qw = qw / norm;
+  m_qx = qx / norm;
+  m_qy = qy / norm;
+  m_qz = qz / norm;
+
+  // measurement
+  buildGrid(markers);
+  float const cutoffSqr = m_cutoff * m_cutoff;
+  float const invTwoSigmaSqr = 1 / (2 * m_markerSigma * m_markerSigma);
+  Array const r00 = 1 - 2 * (m_qy.square() + m_qz.square());
+  Array const r01 = 2 * (m_qx * m_qy - m_qz * m_qw);
+  Array const r02 = 2 * (m_qx * m_qz + m_qy * m_qw);
+  Array const r10 = 2 * (m_qx * m_qy + m_qz * m_qw);
+  Array const r11 = 1 - 2 * (m_qx.square() + m_qz.square());
+  Array const r12 = 2 * (m_qy * m_qz - m_qx * m_qw);
+  Array const r20 = 2 * (m_qx * m_qz - m_qy * m_qw);
+  Array const r21 = 2 * (m_qy * m_qz + m_qx * m_qw);
+  Array const r22 = 1 - 2 * (m_qx.square() + m_qy.square());
+  m_logWeights.setZero();
+  for (const auto& p : model) {
+    Array const px = m_x + r00 * p.x + r01 * p.y + r02 * p.z;
+    Array const py = m_y + r10 * p.x + r11 * p.y + r12 * p.z;
+    Array const pz = m_z + r20 * p.x + r21 * p.y + r22 * p.z;
+    for (Eigen::Index i = 0; i < n; ++i) {
+      float d = nearestSqrDist(Eigen::Vector3f(px[i], py[i], pz[i]));
+      m_logWeights[i] -= (d < 0 ? cutoffSqr : d) * invTwoSigmaSqr;
+    }
+  }
+  m_weights = (m_logWeights - m_logWeights.maxCoeff()).exp() * m_weights;
+  m_weights /= m_weights.sum();
+
+  // estimate; quaternions are averaged on the hemisphere of the best particle
+  Eigen::Index best;
+  m_weights.maxCoeff(&best);
+  Array const sign = ((m_qx * m_qx[best] + m_qy * m_qy[best] + m_qz * m_qz[best] + m_qw * m_qw[best]) < 0)
+    .select(Array::Constant(n, -1), Array::Constant(n, 1)) * m_weights;
+  Eigen::Quaternionf const q = Eigen::Quaternionf(
+    (sign * m_qw).sum(), (sign * m_qx).sum(), (sign * m_qy).sum(), (sign * m_qz).sum()).normalized();
+  Eigen::Affine3f const estimate = Eigen::Translation3f(
+    (m_weights * m_x).sum(), (m_weights * m_y).sum(), (m_weights * m_z).sum()) * q;
+
+  if ((1 / m_weights.square().sum()) < n / 2) {
+    resample();
+  }
+
+  size_t matched = 0;
+  float sum = 0;
+  markersUsed = 0;
+  for (size_t i = 0; i < model.size(); ++i) {
+    float d = nearestSqrDist(estimate * model[i].getVector3fMap());
+    if (d >= 0) {
+      ++matched;
+      sum += d;
+      if (i < 32) {
+        markersUsed |= 1u << i;
+      }
+    }
+  }
+  fitness = matched > 0 ? sum / matched : std::numeric_limits<float>::max();
+  if (matched > 0) {
+    m_estimate = estimate;
+  }
+  return matched;
+}
+
+void ParticleFilter::resample()
+{
+  // systematic resampling
+  Eigen::Index const n = size();
+  std::uniform_real_distribution<float> uniform(0, 1.0f / n);
+  float u = uniform(m_random);
+  float cumulative = m_weights[0];
+  m_resampled.resize(n);
+  Eigen::Index j = 0;
+  for (Eigen::Index i = 0; i < n; ++i) {
+    while (u > cumulative && j < n - 1) {
+      cumulative += m_weights[++j];
+    }
+    m_resampled[i] = j;
+    u += 1.0f / n;
+  }
+  m_scratch.resize(n);
+  for (Array* a : {&m_x, &m_y, &m_z, &m_qx, &m_qy, &m_qz, &m_qw}) {
+    for (Eigen::Index i = 0; i < n; ++i) {
+      m_scratch[i] = (*a)[m_resampled[i]];
+    }
+    a->swap(m_scratch);
+  }
+  m_weights.setConstant(1.0f / n);
+}
+
+} // namespace libobjecttracker
@@ -1,5 +1,6 @@
 #include "libobjecttracker/object_tracker.h"
 #include "libobjecttracker/cloudlog.hpp"
+#include "libobjecttracker/configuration_cache.h"
 #include "yaml-cpp/yaml.h"
 
 #include <cassert>
@@ -9,6 +10,11 @@
 #include <string>
 
 static std::string YAMLDIR = "../../../../crazyswarm/launch";
+static std::string CACHEFILE = "playclouds.cache";
+// part of the cache key; bump whenever the read* functions below change
+// what they make of the same sources (e.g. new keys), so older caches
+// are parsed again
+static std::string PARSER_VERSION = "2";
 
 static void log_stderr(std::string s)
 {
@@ -35,9 +41,8 @@ std::string wholefile(std::string path)
   return str;
 }
 
-YAML::Node rosparams()
+YAML::Node rosparams(std::string const &file)
 {
-  std::string file = wholefile(YAMLDIR + "/hover_swarm.launch");
   auto begin = file.find("<rosparam>") + strlen("<rosparam>");
   auto end = file.find("</rosparam>");
   return YAML::Load(file.substr(begin, end - begin));
@@ -52,9 +57,9 @@ Eigen::Vector3f asVec(YAML::Node const &node)
 }
 
 static void readMarkerConfigurations(
+  YAML::Node const &config_root,
   std::vector<libobjecttracker::MarkerConfiguration>& markerConfigurations)
 {
-  YAML::Node config_root = rosparams();
   auto markerRoot = config_root["markerConfigurations"];
   assert(markerRoot.IsMap());
 
@@ -73,9 +78,9 @@ static void readMarkerConfigurations(
 }
 
 static void readDynamicsConfigurations(
+  YAML::Node const &config_root,
   std::vector<libobjecttracker::DynamicsConfiguration>& dynamicsConfigurations)
 {
-  YAML::Node config_root = rosparams();
   auto dynRoot = config_root["dynamicsConfigurations"];
   assert(dynRoot.IsMap());
 
@@ -94,19 +99,24 @@ static void readDynamicsConfigurations(
     conf.maxRoll = val["maxRoll"].as<float>();
     conf.maxPitch = val["maxPitch"].as<float>();
     conf.maxFitnessScore = val["maxFitnessScore"].as<float>();
+    conf.numParticles = val["numParticles"] ? val["numParticles"].as<uint32_t>() : 0;
   }
 }
 
-static void readObjects(std::vector<libobjecttracker::Object>& objects)
+static void readObjects(
+  YAML::Node const &cfs_root,
+  std::vector<libobjecttracker::Object>& objects)
 {
-  YAML::Node cfs_root = YAML::LoadFile(YAMLDIR + "/crazyflies.yaml");
   auto cfs = cfs_root["crazyflies"];
   assert(cfs.IsSequence());
   for (auto &&cf : cfs) {
     assert(cf.IsMap());
     auto initPos = cf["initialPosition"];
     Eigen::Affine3f xf(Eigen::Translation3f(asVec(initPos)));
-    objects.emplace_back(0, 0, xf);
+    // mixed fleets give the configuration indices; default is the first one
+    size_t markerIdx = cf["markerConfiguration"] ? cf["markerConfiguration"].as<size_t>() : 0;
+    size_t dynIdx = cf["dynamicsConfiguration"] ? cf["dynamicsConfiguration"].as<size_t>() : 0;
+    objects.emplace_back(markerIdx, dynIdx, xf);
   }
 }
 
@@ -123,9 +133,24 @@ int main(int argc, char **argv)
   std::vector<MarkerConfiguration> markerConfigurations;
   std::vector<Object> objects;
 
-  readMarkerConfigurations(markerConfigurations);
-  readDynamicsConfigurations(dynamicsConfigurations);
-  readObjects(objects);
+  // parsing the YAML is slow for large swarms, so the parsed
+  // configuration is cached, keyed by the content of the sources
+  std::string launch = wholefile(YAMLDIR + "/hover_swarm.launch");
+  std::string crazyflies = wholefile(YAMLDIR + "/crazyflies.yaml");
+  uint64_t hash = configurationHash({PARSER_VERSION, launch, crazyflies});
+  if (!loadConfigurationCache(CACHEFILE, hash,
+      dynamicsConfigurations, markerConfigurations, objects)) {
+    YAML::Node config_root = rosparams(launch);
+    readMarkerConfigurations(config_root, markerConfigurations);
+    readDynamicsConfigurations(config_root, dynamicsConfigurations);
+    readObjects(YAML::Load(crazyflies), objects);
+    try {
+      writeConfigurationCache(CACHEFILE, hash,
+        dynamicsConfigurations, markerConfigurations, objects);
+    } catch (std::runtime_error const &e) {
+      std::cerr << "warning: " << e.what() << "\n";
+    }
+  }
 
   std::cout << dynamicsConfigurations.size() << " dynamics configurations, "
             << markerConfigurations.size() << " marker configurations, "
@@ -137,6 +162,10 @@ int main(int argc, char **argv)
     objects);
 
   tracker.setLogWarningCallback(&log_stderr);
+  // with several vehicle types, find each object by its marker geometry
+  if (markerConfigurations.size() > 1) {
+    tracker.setIdentification(true);
+  }
   if (argc < 3) {
     PointCloudPlayer player;
     player.load(argv[1]);
@@ -0,0 +1,90 @@
+#include "libobjecttracker/pose_history.h"
+
+#include <algorithm>
+
+namespace libobjecttracker {
+
+const size_t PoseHistory::DefaultCapacity;
+
+PoseHistory::PoseHistory(size_t capacity)
+  : m_entries(std::max<size_t>(capacity, 1))
+  , m_head(0)
+  , m_size(0)
+{
+}
+
+void PoseHistory::append(TimePoint stamp, const Eigen::Affine3f& pose)
+{
+  if (m_size > 0 && stamp <= latest().stamp) {
+    return;
+  }
+  Entry& entry = m_entries[m_head];
+  entry.stamp = stamp;
+  entry.position = pose.translation();
+  entry.orientation = Eigen::Quaternionf(pose.rotation());
+  m_head = (m_head + 1) % m_entries.size();
+  m_size = std::min(m_size + 1, m_entries.size());
+}
+
+void PoseHistory::clear()
+{
+  m_head = 0;
+  m_size = 0;
+}
+
+const PoseHistory::Entry& PoseHistory::operator[](size_t i) const
+{
+  size_t const n = m_entries.size();
+  return m_entries[(m_head + n - m_size + i) % n];
+}
+
+static Eigen::Affine3f interpolate(
+  const PoseHistory::Entry& a,
+  const PoseHistory::Entry& b,
+  PoseHistory::TimePoint stamp)
+{
+  std::chrono::duration<float> const span = b.stamp - a.stamp;
+  std::chrono::duration<float> const offset = stamp - a.stamp;
+  float const s = offset.count() / span.count();
+  // s > 1 extrapolates along the same rotation axis
+  return Eigen::Translation3f(a.position + s * (b.position - a.position))
+    * a.orientation.slerp(s, b.orientation);
+}
+
+bool PoseHistory::poseAt(TimePoint stamp,
+  Eigen::Affine3f& pose,
+  std::chrono::high_resolution_clock::duration maxExtrapolation) const
+{
+  if (m_size == 0 || stamp < (*this)[0].stamp) {
+    return false;
+  }
+
+  const Entry& last = latest();
+  if (stamp >= last.stamp) {
+    if (stamp - last.stamp > maxExtrapolation) {
+      return false;
+    }
+    if (m_size == 1) {
+      pose = Eigen::Translation3f(last.position) * last.orientation;
+    } else {
+      pose = interpolate((*this)[m_size - 2], last, stamp);
+    }
+    return true;
+  }
+
+  // first entry newer than stamp; exists since stamp < last.stamp
+  size_t lo = 1;
+  size_t hi = m_size - 1;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if ((*this)[mid].stamp > stamp) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  pose = interpolate((*this)[lo - 1], (*this)[lo], stamp);
+  return true;
+}
+
+} // namespace libobjecttracker
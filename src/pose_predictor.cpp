@@ -0,0 +1,143 @@
+#include "libobjecttracker/pose_predictor.h"
+#include "libobjecttracker/object_tracker.h"
+
+#include <Eigen/Geometry>
+
+namespace libobjecttracker {
+
+PosePredictor::PosePredictor(double rate,
+  std::chrono::high_resolution_clock::duration maxExtrapolation)
+  : m_period(std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(
+      std::chrono::duration<double>(1.0 / rate)))
+  , m_maxExtrapolation(std::chrono::duration<double>(maxExtrapolation).count())
+  , m_running(true)
+{
+  m_thread = std::thread(&PosePredictor::run, this);
+}
+
+PosePredictor::~PosePredictor()
+{
+  m_running = false;
+  m_thread.join();
+}
+
+void PosePredictor::publish(std::chrono::high_resolution_clock::time_point stamp,
+  const std::vector<Object>& objects)
+{
+  MotionState& state = m_input.back();
+  state.clockOffset = stamp - std::chrono::high_resolution_clock::now();
+
+  // only reallocates if the number of objects changed
+  Eigen::Index const n = objects.size();
+  for (auto* a : {&state.x, &state.y, &state.z,
+                  &state.qx, &state.qy, &state.qz, &state.qw,
+                  &state.vx, &state.vy, &state.vz,
+                  &state.wx, &state.wy, &state.wz}) {
+    a->resize(n);
+  }
+  state.stamp.resize(n);
+  state.valid.resize(n);
+
+  for (Eigen::Index i = 0; i < n; ++i) {
+    const Object& object = objects[i];
+    const PoseHistory& history = object.history();
+    state.valid[i] = object.active() && !history.empty();
+    if (!state.valid[i]) {
+      state.stamp[i] = 0;
+      state.x[i] = state.y[i] = state.z[i] = 0;
+      state.qx[i] = state.qy[i] = state.qz[i] = 0;
+      state.qw[i] = 1;
+      state.vx[i] = state.vy[i] = state.vz[i] = 0;
+      state.wx[i] = state.wy[i] = state.wz[i] = 0;
+      continue;
+    }
+    // extrapolate from the last valid pose
+    const PoseHistory::Entry& latest = history.latest();
+    state.stamp[i] = std::chrono::duration<double>(latest.stamp.time_since_epoch()).count();
+    state.x[i] = latest.position.x();
+    state.y[i] = latest.position.y();
+    state.z[i] = latest.position.z();
+    state.qx[i] = latest.orientation.x();
+    state.qy[i] = latest.orientation.y();
+    state.qz[i] = latest.orientation.z();
+    state.qw[i] = latest.orientation.w();
+    Eigen::Vector3f velocity = object.velocity();
+    state.vx[i] = velocity.x();
+    state.vy[i] = velocity.y();
+    state.vz[i] = velocity.z();
+
+    // angular velocity (world frame) from the two latest poses
+    Eigen::Vector3f omega(0, 0, 0);
+    if (history.size() >= 2) {
+      const PoseHistory::Entry& previous = history[history.size() - 2];
+      std::chrono::duration<float> dt = latest.stamp - previous.stamp;
+      // q and -q are the same orientation; take the shorter way, otherwise
+      // a sign flip between the poses reads as a turn by almost 2 pi
+      Eigen::Quaternionf q = latest.orientation * previous.orientation.inverse();
+      if (q.w() < 0) {
+        q.coeffs() *= -1;
+      }
+      Eigen::AngleAxisf delta(q);
+      omega = delta.axis() * (delta.angle() / dt.count());
+    }
+    state.wx[i] = omega.x();
+    state.wy[i] = omega.y();
+    state.wz[i] = omega.z();
+  }
+
+  m_input.publish();
+}
+
+const PredictedPoses& PosePredictor::poses()
+{
+  m_output.update();
+  return m_output.front();
+}
+
+void PosePredictor::run()
+{
+  bool hasInput = false;
+  auto next = std::chrono::high_resolution_clock::now();
+  while (m_running) {
+    next += m_period;
+    std::this_thread::sleep_until(next);
+    hasInput = m_input.update() || hasInput;
+    if (!hasInput) {
+      continue;
+    }
+    predict(m_input.front(), std::chrono::high_resolution_clock::now(), m_output.back());
+    m_output.publish();
+  }
+}
+
+void PosePredictor::predict(const MotionState& state,
+  std::chrono::high_resolution_clock::time_point now,
+  PredictedPoses& poses)
+{
+  // all objects at once, so that Eigen can vectorize each step
+  poses.stamp = now + state.clockOffset;
+  double const t = std::chrono::duration<double>(poses.stamp.time_since_epoch()).count();
+  Eigen::ArrayXf const age = (t - state.stamp).cast<float>();
+  Eigen::ArrayXf const dt = age.max(0.0f).min(float(m_maxExtrapolation));
+
+  poses.x = state.x + state.vx * dt;
+  poses.y = state.y + state.vy * dt;
+  poses.z = state.z + state.vz * dt;
+
+  // rotate by exp(omega * dt), applied in the world frame
+  Eigen::ArrayXf const wn = (state.wx.square() + state.wy.square() + state.wz.square()).sqrt();
+  Eigen::ArrayXf const half = 0.5f * wn * dt;
+  Eigen::ArrayXf const c = half.cos();
+  Eigen::ArrayXf const s = (wn > 1e-6f).select(half.sin() / wn, 0.5f * dt);
+  poses.qw = c * state.qw - s * (state.wx * state.qx + state.wy * state.qy + state.wz * state.qz);
+  poses.qx = c * state.qx + s * (state.wx * state.qw + state.wy * state.qz - state.wz * state.qy);
+  poses.qy = c * state.qy + s * (state.wy * state.qw + state.wz * state.qx - state.wx * state.qz);
+  poses.qz = c * state.qz + s * (state.wz * state.qw + state.wx * state.qy - state.wy * state.qx);
+
+  poses.valid.resize(state.valid.size());
+  for (Eigen::Index i = 0; i < state.valid.size(); ++i) {
+    poses.valid[i] = state.valid[i] && age[i] <= m_maxExtrapolation;
+  }
+}
+
+} // namespace libobjecttracker
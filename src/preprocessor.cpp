@@ -0,0 +1,170 @@
+#include "libobjecttracker/preprocessor.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace libobjecttracker {
+
+Preprocessor::Preprocessor()
+  : m_hasWorkspace(false)
+  , m_workspaceMin()
+  , m_workspaceMax()
+  , m_hasFloor(false)
+  , m_floor()
+  , m_mergeDistance(0)
+  , m_lastFrame()
+  , m_total()
+{
+  memset(&m_lastFrame, 0, sizeof(m_lastFrame));
+  memset(&m_total, 0, sizeof(m_total));
+}
+
+void Preprocessor::setWorkspace(const Eigen::Vector3f& min, const Eigen::Vector3f& max)
+{
+  m_hasWorkspace = true;
+  m_workspaceMin = min;
+  m_workspaceMax = max;
+}
+
+void Preprocessor::setFloorPlane(const Eigen::Vector4f& plane)
+{
+  m_hasFloor = true;
+  m_floor = plane;
+}
+
+void Preprocessor::setMergeDistance(float distance)
+{
+  m_mergeDistance = distance;
+}
+
+pcl::PointCloud<pcl::PointXYZ>::ConstPtr Preprocessor::process(
+  pcl::PointCloud<pcl::PointXYZ>::ConstPtr cloud)
+{
+  typedef Eigen::Array<bool, 1, Eigen::Dynamic> Mask;
+
+  PreprocessingStatistics& stats = m_lastFrame;
+  memset(&stats, 0, sizeof(stats));
+  Eigen::Index const n = cloud->size();
+  stats.input = n;
+
+  Mask keep = Mask::Constant(n, true);
+  if (n > 0) {
+    // view the xyz fields of all points as one 3 x n matrix
+    Eigen::Map<const Eigen::Matrix<float, 3, Eigen::Dynamic>, Eigen::Unaligned, Eigen::OuterStride<> >
+      xyz(&(*cloud)[0].x, 3, n, Eigen::OuterStride<>(sizeof(pcl::PointXYZ) / sizeof(float)));
+
+    // false for NaN and inf
+    Mask const finite = (xyz.array().abs() <= std::numeric_limits<float>::max()).colwise().all();
+    stats.nonFinite = n - finite.count();
+    keep = finite;
+
+    if (m_hasWorkspace) {
+      Mask const inside =
+           (xyz.row(0).array() >= m_workspaceMin.x()) && (xyz.row(0).array() <= m_workspaceMax.x())
+        && (xyz.row(1).array() >= m_workspaceMin.y()) && (xyz.row(1).array() <= m_workspaceMax.y())
+        && (xyz.row(2).array() >= m_workspaceMin.z()) && (xyz.row(2).array() <= m_workspaceMax.z());
+      stats.outsideWorkspace = keep.count() - (keep && inside).count();
+      keep = keep && inside;
+    }
+
+    if (m_hasFloor) {
+      Mask const above = ((m_floor.head<3>().transpose() * xyz).array() + m_floor.w()) >= 0;
+      stats.belowFloor = keep.count() - (keep && above).count();
+      keep = keep && above;
+    }
+  }
+
+  pcl::PointCloud<pcl::PointXYZ>::ConstPtr result = cloud;
+  size_t const kept = keep.count();
+  if (kept != (size_t)n || m_mergeDistance > 0) {
+    pcl::PointCloud<pcl::PointXYZ>::Ptr filtered(new pcl::PointCloud<pcl::PointXYZ>);
+    filtered->reserve(kept);
+    for (Eigen::Index i = 0; i < n; ++i) {
+      if (keep[i]) {
+        filtered->push_back((*cloud)[i]);
+      }
+    }
+    if (m_mergeDistance > 0) {
+      stats.merged = merge(*filtered);
+    }
+    // nothing removed after all
+    if (filtered->size() != (size_t)n) {
+      result = filtered;
+    }
+  }
+
+  stats.output = result->size();
+  m_total.input += stats.input;
+  m_total.nonFinite += stats.nonFinite;
+  m_total.outsideWorkspace += stats.outsideWorkspace;
+  m_total.belowFloor += stats.belowFloor;
+  m_total.merged += stats.merged;
+  m_total.output += stats.output;
+  return result;
+}
+
+uint64_t Preprocessor::key(const Eigen::Vector3f& p, int dx, int dy, int dz) const
+{
+  // 21 bits per axis
+  uint64_t const mask = (1 << 21) - 1;
+  uint64_t const x = ((int64_t)std::floor(p.x() / m_mergeDistance) + dx) & mask;
+  uint64_t const y = ((int64_t)std::floor(p.y() / m_mergeDistance) + dy) & mask;
+  uint64_t const z = ((int64_t)std::floor(p.z() / m_mergeDistance) + dz) & mask;
+  return (x << 42) | (y << 21) | z;
+}
+
+size_t Preprocessor::merge(pcl::PointCloud<pcl::PointXYZ>& cloud)
+{
+  // Cells of the merge distance; merged markers are searched in the
+  // neighboring cells. Markers in the same cell are chained through
+  // m_next, so no per-cell allocations are needed.
+  float const maxSqrDist = m_mergeDistance * m_mergeDistance;
+  m_cells.clear();
+  m_next.clear();
+  m_counts.clear();
+
+  size_t out = 0;
+  for (size_t i = 0; i < cloud.size(); ++i) {
+    Eigen::Vector3f const p = cloud[i].getVector3fMap();
+    int found = -1;
+    for (int dx = -1; dx <= 1 && found < 0; ++dx) {
+      for (int dy = -1; dy <= 1 && found < 0; ++dy) {
+        for (int dz = -1; dz <= 1 && found < 0; ++dz) {
+          auto it = m_cells.find(key(p, dx, dy, dz));
+          for (int j = it == m_cells.end() ? -1 : it->second; j >= 0; j = m_next[j]) {
+            // compare against the current mean of the cluster
+            if ((cloud[j].getVector3fMap() - p).squaredNorm() <= maxSqrDist) {
+              found = j;
+              break;
+            }
+          }
+        }
+      }
+    }
+
+    if (found >= 0) {
+      // running mean; the cluster keeps its cell
+      int const count = ++m_counts[found];
+      Eigen::Vector3f mean = cloud[found].getVector3fMap();
+      mean += (p - mean) / count;
+      cloud[found] = pcl::PointXYZ(mean.x(), mean.y(), mean.z());
+      continue;
+    }
+
+    cloud[out] = cloud[i];
+    auto inserted = m_cells.insert(std::make_pair(key(p, 0, 0, 0), (int)out));
+    m_next.push_back(inserted.second ? -1 : inserted.first->second);
+    inserted.first->second = out;
+    m_counts.push_back(1);
+    ++out;
+  }
+
+  size_t const merged = cloud.size() - out;
+  cloud.points.resize(out);
+  cloud.width = out;
+  cloud.height = 1;
+  return merged;
+}
+
+} // namespace libobjecttracker
@@ -0,0 +1,243 @@
+#include "libobjecttracker/registration.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <Eigen/SVD>
+
+namespace libobjecttracker {
+
+template <typename Scalar, int NumMarkers>
+RigidRegistration<Scalar, NumMarkers>::RigidRegistration()
+  : m_maxCorrespondenceDistance(std::numeric_limits<Scalar>::max())
+  , m_maxIterations(5)
+  , m_loss(RobustLoss::None)
+  , m_lossParameter(0)
+  , m_transformation(Transform::Identity())
+  , m_fitness(std::numeric_limits<Scalar>::max())
+  , m_iterations(0)
+{
+}
+
+template <typename Scalar, int NumMarkers>
+typename RigidRegistration<Scalar, NumMarkers>::Transform
+RigidRegistration<Scalar, NumMarkers>::estimateRigidTransform(
+  const ModelMatrix& src,
+  const ModelMatrix& dst,
+  const WeightVector& weights,
+  int n)
+{
+  Scalar const sum = weights.head(n).sum();
+  Vector const srcMean = src.leftCols(n) * weights.head(n).transpose() / sum;
+  Vector const dstMean = dst.leftCols(n) * weights.head(n).transpose() / sum;
+
+  Eigen::Matrix<Scalar, 3, 3> H = Eigen::Matrix<Scalar, 3, 3>::Zero();
+  for (int i = 0; i < n; ++i) {
+    H += weights(i) * (src.col(i) - srcMean) * (dst.col(i) - dstMean).transpose();
+  }
+
+  Eigen::JacobiSVD<Eigen::Matrix<Scalar, 3, 3> > svd(H, Eigen::ComputeFullU | Eigen::ComputeFullV);
+  Eigen::Matrix<Scalar, 3, 3> const& U = svd.matrixU();
+  Eigen::Matrix<Scalar, 3, 3> const& V = svd.matrixV();
+  // avoid reflections
+  Eigen::Matrix<Scalar, 3, 1> d(1, 1, (V * U.transpose()).determinant() < 0 ? -1 : 1);
+  Eigen::Matrix<Scalar, 3, 3> const R = V * d.asDiagonal() * U.transpose();
+
+  Transform t = Transform::Identity();
+  t.linear() = R;
+  t.translation() = dstMean - R * srcMean;
+  return t;
+}
+
+template <typename Scalar, int NumMarkers>
+void RigidRegistration<Scalar, NumMarkers>::setModel(const pcl::PointCloud<pcl::PointXYZ>& model)
+{
+  m_model.resize(3, model.size());
+  for (size_t i = 0; i < model.size(); ++i) {
+    m_model.col(i) = model[i].getVector3fMap().template cast<Scalar>();
+  }
+  m_src.resize(3, model.size());
+  m_dst.resize(3, model.size());
+  m_weights.resize(model.size());
+  m_correspondences.resize(model.size());
+  m_residuals.resize(model.size());
+  m_sorted.resize(model.size());
+  m_previousWeights.resize(model.size());
+}
+
+template <typename Scalar, int NumMarkers>
+void RigidRegistration<Scalar, NumMarkers>::setTarget(const pcl::PointCloud<pcl::PointXYZ>& target)
+{
+  m_target.resize(3, target.size());
+  for (size_t i = 0; i < target.size(); ++i) {
+    m_target.col(i) = target[i].getVector3fMap().template cast<Scalar>();
+  }
+}
+
+template <typename Scalar, int NumMarkers>
+void RigidRegistration<Scalar, NumMarkers>::setMaxCorrespondenceDistance(Scalar distance)
+{
+  m_maxCorrespondenceDistance = distance;
+}
+
+template <typename Scalar, int NumMarkers>
+void RigidRegistration<Scalar, NumMarkers>::setMaximumIterations(int iterations)
+{
+  m_maxIterations = iterations;
+}
+
+template <typename Scalar, int NumMarkers>
+void RigidRegistration<Scalar, NumMarkers>::setRobustLoss(RobustLoss loss, Scalar parameter)
+{
+  m_loss = loss;
+  m_lossParameter = parameter;
+}
+
+template <typename Scalar, int NumMarkers>
+int RigidRegistration<Scalar, NumMarkers>::nearest(const Vector& p, Scalar& sqrDist) const
+{
+  int best = -1;
+  sqrDist = std::numeric_limits<Scalar>::max();
+  for (int j = 0; j < m_target.cols(); ++j) {
+    Scalar d = (m_target.col(j) - p).squaredNorm();
+    if (d < sqrDist) {
+      sqrDist = d;
+      best = j;
+    }
+  }
+  return best;
+}
+
+template <typename Scalar, int NumMarkers>
+int RigidRegistration<Scalar, NumMarkers>::correspond(const Transform& transformation)
+{
+  Scalar const maxSqrDist = m_maxCorrespondenceDistance * m_maxCorrespondenceDistance;
+  int const nModel = m_model.cols();
+  for (int i = 0; i < nModel; ++i) {
+    Scalar sqrDist;
+    int j = nearest(transformation * m_model.col(i), sqrDist);
+    m_correspondences(i) = sqrDist <= maxSqrDist ? j : -1;
+    m_residuals(i) = sqrDist;
+  }
+
+  // a target marker can only be matched once; the closest model marker
+  // keeps it (matters if a model marker is occluded)
+  int n = 0;
+  for (int i = 0; i < nModel; ++i) {
+    if (m_correspondences(i) < 0) {
+      continue;
+    }
+    for (int k = i + 1; k < nModel; ++k) {
+      if (m_correspondences(k) == m_correspondences(i)) {
+        if (m_residuals(k) < m_residuals(i)) {
+          m_correspondences(i) = -1;
+          break;
+        }
+        m_correspondences(k) = -1;
+      }
+    }
+    n += m_correspondences(i) >= 0;
+  }
+  return n;
+}
+
+template <typename Scalar, int NumMarkers>
+int RigidRegistration<Scalar, NumMarkers>::weighCorrespondences()
+{
+  int const nModel = m_model.cols();
+
+  // residual below which correspondences are kept when trimming
+  Scalar trimSqr = std::numeric_limits<Scalar>::max();
+  if (m_loss == RobustLoss::Trimmed) {
+    int n = 0;
+    for (int i = 0; i < nModel; ++i) {
+      if (m_correspondences(i) >= 0) {
+        m_sorted(n++) = m_residuals(i);
+      }
+    }
+    int const keep = std::min(n, std::max(3, (int)std::ceil(m_lossParameter * n)));
+    std::nth_element(m_sorted.data(), m_sorted.data() + keep - 1, m_sorted.data() + n);
+    trimSqr = m_sorted(keep - 1);
+  }
+
+  int n = 0;
+  int nonZero = 0;
+  for (int i = 0; i < nModel; ++i) {
+    if (m_correspondences(i) < 0) {
+      continue;
+    }
+    Scalar const r = std::sqrt(m_residuals(i));
+    Scalar w = 1;
+    switch (m_loss) {
+    case RobustLoss::None:
+      break;
+    case RobustLoss::Trimmed:
+      w = m_residuals(i) <= trimSqr ? 1 : 0;
+      break;
+    case RobustLoss::Huber:
+      w = r <= m_lossParameter ? 1 : m_lossParameter / r;
+      break;
+    case RobustLoss::Tukey:
+      w = r < m_lossParameter ? std::pow(1 - (r / m_lossParameter) * (r / m_lossParameter), 2) : 0;
+      break;
+    }
+    m_src.col(n) = m_model.col(i);
+    m_dst.col(n) = m_target.col(m_correspondences(i));
+    m_weights(n) = w;
+    nonZero += w > 0;
+    ++n;
+  }
+
+  // not enough support for a robust fit; use least squares instead
+  if (nonZero < 3) {
+    m_weights.head(n).setOnes();
+  }
+  return n;
+}
+
+template <typename Scalar, int NumMarkers>
+bool RigidRegistration<Scalar, NumMarkers>::align(const Transform& guess)
+{
+  m_transformation = guess;
+  m_fitness = std::numeric_limits<Scalar>::max();
+  m_iterations = 0;
+
+  int const nModel = m_model.cols();
+  Eigen::Matrix<int, 1, NumMarkers> previous(1, nModel);
+  previous.setConstant(-2);
+
+  for (m_iterations = 0; m_iterations < m_maxIterations; ++m_iterations) {
+    int const n = correspond(m_transformation);
+    if (n < 3) {
+      return false;
+    }
+    int const m = weighCorrespondences();
+
+    // same correspondences with (nearly) the same weights as in the
+    // last iteration: the fit would not change
+    if (m_correspondences == previous
+        && (m_weights.head(m) - m_previousWeights.head(m)).cwiseAbs().maxCoeff() < Scalar(0.01)) {
+      break;
+    }
+    previous = m_correspondences;
+    m_previousWeights.head(m) = m_weights.head(m);
+
+    m_transformation = estimateRigidTransform(m_src, m_dst, m_weights, n);
+  }
+
+  // final correspondences, and the mean squared distance of
+  // all model markers to their nearest target marker
+  if (correspond(m_transformation) < 3) {
+    return false;
+  }
+  m_fitness = m_residuals.sum() / nModel;
+  return true;
+}
+
+template class RigidRegistration<float, 4>;
+template class RigidRegistration<float, Eigen::Dynamic>;
+template class RigidRegistration<double, 4>;
+template class RigidRegistration<double, Eigen::Dynamic>;
+
+} // namespace libobjecttracker
@@ -0,0 +1,111 @@
+// Scaling study: runs the tracker on synthetic swarms and sweeps
+// thread count x object count x marker noise. Writes one CSV row per
+// configuration with throughput, latency percentiles and the speedup
+// relative to a single thread.
+//
+// usage: scaling [output.csv] [frames per run]
+
+#include "libobjecttracker/object_tracker.h"
+#include "synthetic_swarm.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <tuple>
+
+using namespace libobjecttracker;
+
+struct Result
+{
+  double throughput;
+  double p50;
+  double p99;
+  double validFraction;
+};
+
+static Result run(size_t numThreads, size_t numObjects, double noise, size_t frames)
+{
+  SyntheticSwarm swarm(numObjects, noise);
+  ObjectTracker tracker(
+    swarm.dynamicsConfigurations,
+    swarm.markerConfigurations,
+    swarm.objects);
+  tracker.setNumThreads(numThreads);
+
+  // the first frame runs the initialization, which is not part of the study
+  static size_t const warmup = 10;
+  for (size_t k = 0; k < warmup; ++k) {
+    tracker.update(swarm.stamp(k), swarm.frame(k));
+  }
+
+  std::vector<double> latencies;
+  latencies.reserve(frames);
+  size_t valid = 0;
+  double total = 0;
+  for (size_t k = warmup; k < warmup + frames; ++k) {
+    auto cloud = swarm.frame(k);
+    auto start = std::chrono::high_resolution_clock::now();
+    tracker.update(swarm.stamp(k), cloud);
+    std::chrono::duration<double> elapsed =
+      std::chrono::high_resolution_clock::now() - start;
+    latencies.push_back(elapsed.count());
+    total += elapsed.count();
+    for (auto const &object : tracker.objects()) {
+      valid += object.lastTransformationValid();
+    }
+  }
+  std::sort(latencies.begin(), latencies.end());
+
+  Result r;
+  r.throughput = frames / total;
+  r.p50 = latencies[latencies.size() / 2];
+  r.p99 = latencies[std::min(latencies.size() - 1, (size_t)(0.99 * latencies.size()))];
+  r.validFraction = (double)valid / (frames * numObjects);
+  return r;
+}
+
+int main(int argc, char **argv)
+{
+  std::string path = argc > 1 ? argv[1] : "scaling.csv";
+  size_t frames = argc > 2 ? std::stoul(argv[2]) : 200;
+
+  std::vector<size_t> threadCounts;
+  size_t hw = std::max(1u, std::thread::hardware_concurrency());
+  for (size_t t = 1; t < hw; t *= 2) {
+    threadCounts.push_back(t);
+  }
+  threadCounts.push_back(hw);
+
+  std::vector<size_t> objectCounts = {1, 10, 50, 100, 200};
+  std::vector<double> noises = {0.0, 0.0005, 0.002};
+
+  std::ofstream csv(path);
+  csv << "threads,objects,noise,frames,throughput_hz,p50_ms,p99_ms,speedup,valid_fraction\n";
+
+  // single-threaded throughput per (objects, noise), for the speedup column
+  std::map<std::tuple<size_t, double>, double> baseline;
+
+  for (size_t objects : objectCounts) {
+    for (double noise : noises) {
+      for (size_t threads : threadCounts) {
+        Result r = run(threads, objects, noise, frames);
+        auto key = std::make_tuple(objects, noise);
+        if (threads == 1) {
+          baseline[key] = r.throughput;
+        }
+        double speedup = r.throughput / baseline[key];
+
+        csv << threads << "," << objects << "," << noise << "," << frames << ","
+            << r.throughput << "," << r.p50 * 1e3 << "," << r.p99 * 1e3 << ","
+            << speedup << "," << r.validFraction << "\n";
+        std::cout << threads << " threads, " << objects << " objects, noise "
+                  << noise << ": " << r.throughput << " Hz, p99 "
+                  << r.p99 * 1e3 << " ms, speedup " << speedup
+                  << ", valid " << r.validFraction << std::endl;
+      }
+    }
+  }
+}
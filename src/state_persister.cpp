@@ -0,0 +1,186 @@
+#include "libobjecttracker/state_persister.h"
+#include "libobjecttracker/object_tracker.h"
+
+#include <cstdio>
+#include <fstream>
+
+static const uint32_t MAGIC = 0x53544f4c; // "LOTS"
+static const uint32_t VERSION = 2;
+// bytes per object in the file, see state_persister.h
+static const size_t RECORD_SIZE = 2 * 4 + 1 + 8 + 10 * 4;
+
+template <typename T>
+static void write(std::ofstream &s, T const &t)
+{
+  s.write((char const *)&t, sizeof(T));
+}
+
+template <typename T>
+static bool read(std::ifstream &s, T &t)
+{
+  s.read((char *)&t, sizeof(T));
+  return (bool)s;
+}
+
+namespace libobjecttracker {
+
+bool readState(const std::string& path, std::vector<ObjectState>& states)
+{
+  std::ifstream s(path, std::ios::binary | std::ios::in);
+  uint32_t magic, version, n;
+  if (!read(s, magic) || magic != MAGIC
+      || !read(s, version) || version != VERSION
+      || !read(s, n)) {
+    return false;
+  }
+  // a corrupt count must not make us allocate more than the file holds
+  std::streampos const pos = s.tellg();
+  s.seekg(0, std::ios::end);
+  std::streamoff const remaining = s.tellg() - pos;
+  s.seekg(pos);
+  if (!s || remaining < 0 || (uint64_t)remaining / RECORD_SIZE < n) {
+    return false;
+  }
+  std::vector<ObjectState> result(n);
+  for (auto& state : result) {
+    bool ok = read(s, state.markerConfigurationIdx)
+      && read(s, state.dynamicsConfigurationIdx)
+      && read(s, state.valid)
+      && read(s, state.stamp);
+    for (int i = 0; i < 3; ++i) {
+      ok = ok && read(s, state.position[i]);
+    }
+    for (int i = 0; i < 4; ++i) {
+      ok = ok && read(s, state.orientation[i]);
+    }
+    for (int i = 0; i < 3; ++i) {
+      ok = ok && read(s, state.velocity[i]);
+    }
+    if (!ok) {
+      return false;
+    }
+  }
+  states.swap(result);
+  return true;
+}
+
+bool writeState(const std::string& path, const std::vector<ObjectState>& states)
+{
+  std::string tmp = path + ".tmp";
+  {
+    std::ofstream s(tmp, std::ios::binary | std::ios::out | std::ios::trunc);
+    write(s, MAGIC);
+    write(s, VERSION);
+    write(s, (uint32_t)states.size());
+    for (const auto& state : states) {
+      write(s, state.markerConfigurationIdx);
+      write(s, state.dynamicsConfigurationIdx);
+      write(s, state.valid);
+      write(s, state.stamp);
+      for (int i = 0; i < 3; ++i) {
+        write(s, state.position[i]);
+      }
+      for (int i = 0; i < 4; ++i) {
+        write(s, state.orientation[i]);
+      }
+      for (int i = 0; i < 3; ++i) {
+        write(s, state.velocity[i]);
+      }
+    }
+    if (!s) {
+      return false;
+    }
+  }
+  return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+void captureState(const Object& object,
+  std::chrono::high_resolution_clock::time_point stamp,
+  std::chrono::system_clock::time_point wallStamp,
+  ObjectState& state)
+{
+  state.markerConfigurationIdx = object.markerConfigurationIdx();
+  state.dynamicsConfigurationIdx = object.dynamicsConfigurationIdx();
+  // objects that were valid recently are still useful for a restart
+  state.valid = object.active() && object.lastValidTime().time_since_epoch().count() != 0;
+  // the tracker's clock may be steady_clock, whose epoch does not
+  // survive a reboot, so the file holds wall clock time
+  state.stamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    (wallStamp - (stamp - object.lastValidTime())).time_since_epoch()).count();
+  Eigen::Vector3f position = object.center();
+  Eigen::Quaternionf orientation(object.transformation().rotation());
+  Eigen::Vector3f velocity = object.velocity();
+  for (int j = 0; j < 3; ++j) {
+    state.position[j] = position[j];
+    state.velocity[j] = velocity[j];
+  }
+  state.orientation[0] = orientation.x();
+  state.orientation[1] = orientation.y();
+  state.orientation[2] = orientation.z();
+  state.orientation[3] = orientation.w();
+}
+
+StatePersister::StatePersister(const std::string& path, std::chrono::milliseconds period)
+  : m_path(path)
+  , m_period(period)
+  , m_lastRecord()
+  , m_pending(false)
+  , m_running(true)
+{
+  m_thread = std::thread(&StatePersister::run, this);
+}
+
+StatePersister::~StatePersister()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_running = false;
+  }
+  m_cv.notify_one();
+  m_thread.join();
+}
+
+void StatePersister::record(std::chrono::high_resolution_clock::time_point stamp,
+  const std::vector<Object>& objects)
+{
+  if (stamp - m_lastRecord < m_period) {
+    return;
+  }
+
+  // if the writer is busy copying, we try again next frame
+  std::unique_lock<std::mutex> lock(m_mutex, std::try_to_lock);
+  if (!lock.owns_lock()) {
+    return;
+  }
+  m_lastRecord = stamp;
+  std::chrono::system_clock::time_point const wallStamp = std::chrono::system_clock::now();
+
+  m_states.resize(objects.size());
+  for (size_t i = 0; i < objects.size(); ++i) {
+    captureState(objects[i], stamp, wallStamp, m_states[i]);
+  }
+  m_pending = true;
+  lock.unlock();
+  m_cv.notify_one();
+}
+
+void StatePersister::run()
+{
+  std::vector<ObjectState> states;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cv.wait(lock, [this] { return m_pending || !m_running; });
+      // a state recorded before shutdown is still written
+      if (!m_pending) {
+        return;
+      }
+      states = m_states;
+      m_pending = false;
+    }
+
+    writeState(m_path, states);
+  }
+}
+
+} // namespace libobjecttracker
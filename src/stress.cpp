@@ -0,0 +1,259 @@
+// Worst-case input stress test: feeds pathological frames through the
+// initialization and the tracking path of ObjectTracker::update and
+// reports the worst frame time per scenario, then checks the results of
+// a few hard inputs. Exits with a non-zero status if any frame exceeds
+// the bound or any check fails.
+//
+// usage: stress [bound in ms (default 100)] [number of objects (default 10)]
+
+#include "libobjecttracker/object_tracker.h"
+#include "libobjecttracker/configuration_cache.h"
+#include "synthetic_swarm.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <functional>
+#include <limits>
+#include <random>
+#include <string>
+
+using namespace libobjecttracker;
+
+using Point = pcl::PointXYZ;
+using Cloud = pcl::PointCloud<Point>;
+
+typedef std::function<Cloud::Ptr(SyntheticSwarm&, size_t)> FrameGenerator;
+
+static std::default_random_engine eng(42);
+
+static double timeUpdate(ObjectTracker& tracker,
+  std::chrono::high_resolution_clock::time_point stamp,
+  Cloud::Ptr cloud)
+{
+  auto start = std::chrono::high_resolution_clock::now();
+  tracker.update(stamp, cloud);
+  std::chrono::duration<double> elapsed =
+    std::chrono::high_resolution_clock::now() - start;
+  return elapsed.count();
+}
+
+// add n reflections spread over a 10m x 10m x 3m arena
+static Cloud::Ptr reflections(Cloud::Ptr cloud, size_t n)
+{
+  std::uniform_real_distribution<float> xy(-5, 5);
+  std::uniform_real_distribution<float> z(0, 3);
+  for (size_t i = 0; i < n; ++i) {
+    cloud->push_back(Point(xy(eng), xy(eng), z(eng)));
+  }
+  return cloud;
+}
+
+static Cloud::Ptr singlePoint(size_t n)
+{
+  Cloud::Ptr cloud(new Cloud);
+  for (size_t i = 0; i < n; ++i) {
+    cloud->push_back(Point(0.5, 0.5, 1.0));
+  }
+  return cloud;
+}
+
+// n markers on a line through the swarm
+static Cloud::Ptr colinear(size_t n)
+{
+  Cloud::Ptr cloud(new Cloud);
+  for (size_t i = 0; i < n; ++i) {
+    float t = (float)i / n;
+    cloud->push_back(Point(-1 + 4 * t, -1 + 4 * t, 1.0));
+  }
+  return cloud;
+}
+
+static Cloud::Ptr withNaNs(Cloud::Ptr cloud, size_t n)
+{
+  float nan = std::numeric_limits<float>::quiet_NaN();
+  float inf = std::numeric_limits<float>::infinity();
+  for (size_t i = 0; i < n; ++i) {
+    cloud->push_back(Point(nan, nan, nan));
+    cloud->push_back(Point(0.5, inf, 1.0));
+  }
+  cloud->is_dense = false;
+  return cloud;
+}
+
+// runs the scenario once against a fresh tracker (initialization path)
+// and once against an initialized tracker (tracking path).
+// Returns the worst frame time.
+static double scenario(const std::string& name, size_t numObjects,
+  FrameGenerator generate)
+{
+  static size_t const frames = 20;
+
+  double worstInit = 0;
+  {
+    SyntheticSwarm swarm(numObjects, 0.0005);
+    ObjectTracker tracker(
+      swarm.dynamicsConfigurations,
+      swarm.markerConfigurations,
+      swarm.objects);
+    for (size_t k = 0; k < frames; ++k) {
+      worstInit = std::max(worstInit,
+        timeUpdate(tracker, swarm.stamp(k), generate(swarm, k)));
+    }
+  }
+
+  double worstTrack = 0;
+  {
+    SyntheticSwarm swarm(numObjects, 0.0005);
+    ObjectTracker tracker(
+      swarm.dynamicsConfigurations,
+      swarm.markerConfigurations,
+      swarm.objects);
+    size_t k = 0;
+    for (; k < 10; ++k) {
+      tracker.update(swarm.stamp(k), swarm.frame(k));
+    }
+    for (; k < 10 + frames; ++k) {
+      worstTrack = std::max(worstTrack,
+        timeUpdate(tracker, swarm.stamp(k), generate(swarm, k)));
+    }
+  }
+
+  printf("%-32s init %10.3f ms   track %10.3f ms\n",
+    name.c_str(), worstInit * 1e3, worstTrack * 1e3);
+  return std::max(worstInit, worstTrack);
+}
+
+static bool check(const std::string& name, bool ok)
+{
+  printf("%-32s %s\n", name.c_str(), ok ? "ok" : "FAILED");
+  return ok;
+}
+
+// Vehicles with identification enabled, far from their initial
+// positions: three configurations, one of them shared by two objects.
+static bool identifyDisplaced()
+{
+  SyntheticSwarm swarm(1, 0);
+  const Cloud& base = *swarm.markerConfigurations[0];
+  for (float scale : {1.3f, 1.6f}) {
+    MarkerConfiguration config(new Cloud);
+    for (const auto& p : base) {
+      config->push_back(Point(scale * p.x, scale * p.y, scale * p.z));
+    }
+    swarm.markerConfigurations.push_back(config);
+  }
+
+  size_t const configs[4] = {0, 0, 1, 2};
+  Eigen::Vector3f const actual[4] = {
+    Eigen::Vector3f(2.0, 3.0, 1.0),
+    Eigen::Vector3f(2.5, 3.0, 1.0),
+    Eigen::Vector3f(-1.0, -2.0, 0.5),
+    Eigen::Vector3f(4.0, 0.0, 1.5)};
+  std::vector<Object> objects;
+  std::vector<Eigen::Affine3f, Eigen::aligned_allocator<Eigen::Affine3f> > poses;
+  Cloud::Ptr cloud(new Cloud);
+  for (size_t i = 0; i < 4; ++i) {
+    objects.emplace_back(configs[i], 0,
+      Eigen::Affine3f(Eigen::Translation3f(0.5f * i, 0, 1)));
+    poses.push_back(Eigen::Translation3f(actual[i])
+      * Eigen::AngleAxisf(0.4f * i + 0.3f, Eigen::Vector3f::UnitZ()));
+    for (const auto& p : *swarm.markerConfigurations[configs[i]]) {
+      Eigen::Vector3f v = poses[i] * Eigen::Vector3f(p.x, p.y, p.z);
+      cloud->push_back(Point(v.x(), v.y(), v.z()));
+    }
+  }
+
+  ObjectTracker tracker(
+    swarm.dynamicsConfigurations,
+    swarm.markerConfigurations,
+    objects);
+  tracker.setIdentification(true);
+  tracker.update(swarm.stamp(1), cloud);
+  for (size_t i = 0; i < 4; ++i) {
+    const Object& object = tracker.objects()[i];
+    if (!object.lastTransformationValid()
+        || (object.center() - poses[i].translation()).norm() > 0.005) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// A configuration cache whose counts were overwritten with huge values
+// must be rejected without allocating for them.
+static bool corruptCache()
+{
+  SyntheticSwarm swarm(10, 0);
+  std::string const path = "stress_cache.bin";
+  uint64_t const hash = configurationHash({"stress"});
+  writeConfigurationCache(path, hash,
+    swarm.dynamicsConfigurations, swarm.markerConfigurations, swarm.objects);
+  std::string valid;
+  {
+    std::ifstream s(path, std::ios::binary);
+    valid.assign(std::istreambuf_iterator<char>(s), std::istreambuf_iterator<char>());
+  }
+
+  // offsets of #dynamics, #markers, #objects and the first marker
+  // configuration size, see configuration_cache.h
+  size_t const offsets[4] = {16, 20, 24, 28 + 76 * swarm.dynamicsConfigurations.size()};
+  bool ok = true;
+  for (size_t offset : offsets) {
+    std::string corrupt = valid;
+    uint32_t const count = 0xffffffff;
+    corrupt.replace(offset, sizeof(count), (const char*)&count, sizeof(count));
+    {
+      std::ofstream s(path, std::ios::binary | std::ios::trunc);
+      s.write(corrupt.data(), corrupt.size());
+    }
+    std::vector<DynamicsConfiguration> dyn;
+    std::vector<MarkerConfiguration> markers;
+    std::vector<Object> objects;
+    try {
+      ok = !loadConfigurationCache(path, hash, dyn, markers, objects) && ok;
+    } catch (const std::exception&) {
+      ok = false;
+    }
+  }
+  std::remove(path.c_str());
+  return ok;
+}
+
+int main(int argc, char **argv)
+{
+  double bound = (argc > 1 ? std::stod(argv[1]) : 100) * 1e-3;
+  size_t numObjects = argc > 2 ? std::stoul(argv[2]) : 10;
+
+  double worst = 0;
+  worst = std::max(worst, scenario("clean", numObjects,
+    [](SyntheticSwarm& s, size_t k) { return s.frame(k); }));
+  worst = std::max(worst, scenario("empty", numObjects,
+    [](SyntheticSwarm& s, size_t k) { return Cloud::Ptr(new Cloud); }));
+  worst = std::max(worst, scenario("1000 reflections", numObjects,
+    [](SyntheticSwarm& s, size_t k) { return reflections(s.frame(k), 1000); }));
+  worst = std::max(worst, scenario("5000 reflections", numObjects,
+    [](SyntheticSwarm& s, size_t k) { return reflections(s.frame(k), 5000); }));
+  worst = std::max(worst, scenario("reflections only", numObjects,
+    [](SyntheticSwarm& s, size_t k) { return reflections(Cloud::Ptr(new Cloud), 5000); }));
+  worst = std::max(worst, scenario("1000 markers at one point", numObjects,
+    [](SyntheticSwarm& s, size_t k) { return singlePoint(1000); }));
+  worst = std::max(worst, scenario("1000 colinear markers", numObjects,
+    [](SyntheticSwarm& s, size_t k) { return colinear(1000); }));
+  worst = std::max(worst, scenario("NaN/inf among markers", numObjects,
+    [](SyntheticSwarm& s, size_t k) { return withNaNs(s.frame(k), 100); }));
+  worst = std::max(worst, scenario("NaN/inf only", numObjects,
+    [](SyntheticSwarm& s, size_t k) { return withNaNs(Cloud::Ptr(new Cloud), 100); }));
+
+  bool ok = true;
+  ok = check("identification far from home", identifyDisplaced()) && ok;
+  ok = check("configuration cache, huge counts", corruptCache()) && ok;
+
+  printf("worst frame: %.3f ms (bound %.3f ms)\n", worst * 1e3, bound * 1e3);
+  if (worst > bound || !ok) {
+    printf("FAILED\n");
+    return 1;
+  }
+  printf("OK\n");
+  return 0;
+}
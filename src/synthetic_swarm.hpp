@@ -0,0 +1,115 @@
+#pragma once
+
+#include "libobjecttracker/object_tracker.h"
+
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <pcl/common/transforms.h>
+
+// Synthetic swarm for benchmarks: Crazyflies with the standard 4-marker
+// configuration on a grid, each flying a small circle with slowly
+// changing yaw. Frames are generated at a fixed rate with optional
+// Gaussian marker noise.
+
+namespace libobjecttracker {
+
+	class SyntheticSwarm
+	{
+	public:
+		SyntheticSwarm(size_t numObjects, double noise, double spacing = 0.5)
+			: noise(noise)
+			, frameRate(100)
+			, eng(42)
+			, gauss(0, noise > 0 ? noise : 1)
+		{
+			static const float offset[3] = {0.0, -0.01, -0.04};
+			static const float points[4][3] = {
+				{0.0177184,0.0139654,0.0557585},
+				{-0.0262914,0.0509139,0.0402475},
+				{-0.0328889,-0.02757,0.0390601},
+				{0.0431307,-0.0331216,0.0388839},
+			};
+			MarkerConfiguration cloud(new pcl::PointCloud<pcl::PointXYZ>);
+			for (int i = 0; i < 4; ++i) {
+				cloud->push_back(pcl::PointXYZ(
+					points[i][0] + offset[0],
+					points[i][1] + offset[1],
+					points[i][2] + offset[2]));
+			}
+			markerConfigurations.push_back(cloud);
+
+			DynamicsConfiguration dyn;
+			dyn.maxXVelocity = 2;
+			dyn.maxYVelocity = 2;
+			dyn.maxZVelocity = 3;
+			dyn.maxPitchRate = 20;
+			dyn.maxRollRate = 20;
+			dyn.maxYawRate = 10;
+			dyn.maxRoll = 1.4;
+			dyn.maxPitch = 1.4;
+			dyn.maxFitnessScore = 0.001;
+			dynamicsConfigurations.push_back(dyn);
+
+			size_t side = std::ceil(std::sqrt((double)numObjects));
+			for (size_t i = 0; i < numObjects; ++i) {
+				Eigen::Vector3f home(
+					(i % side) * spacing,
+					(i / side) * spacing,
+					1.0);
+				homes.push_back(home);
+				objects.emplace_back(0, 0, Eigen::Affine3f(Eigen::Translation3f(home)));
+			}
+		}
+
+		// ground truth pose of object i at frame k
+		Eigen::Affine3f pose(size_t i, size_t k) const
+		{
+			float t = k / frameRate;
+			float phase = i * 0.7f;
+			float r = 0.1f;
+			return pcl::getTransformation(
+				homes[i].x() + r * std::cos(t + phase) - r * std::cos(phase),
+				homes[i].y() + r * std::sin(t + phase) - r * std::sin(phase),
+				homes[i].z(),
+				0, 0, 0.5f * std::sin(0.5f * t + phase));
+		}
+
+		std::chrono::high_resolution_clock::time_point stamp(size_t k) const
+		{
+			return std::chrono::high_resolution_clock::time_point(
+				std::chrono::microseconds((int64_t)(1e6 * k / frameRate)));
+		}
+
+		pcl::PointCloud<pcl::PointXYZ>::Ptr frame(size_t k)
+		{
+			pcl::PointCloud<pcl::PointXYZ>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZ>);
+			cloud->reserve(4 * homes.size());
+			for (size_t i = 0; i < homes.size(); ++i) {
+				Eigen::Affine3f xf = pose(i, k);
+				for (auto const &p : *markerConfigurations[0]) {
+					Eigen::Vector3f v = xf * Eigen::Vector3f(p.x, p.y, p.z);
+					if (noise > 0) {
+						v += Eigen::Vector3f(gauss(eng), gauss(eng), gauss(eng));
+					}
+					cloud->push_back(pcl::PointXYZ(v.x(), v.y(), v.z()));
+				}
+			}
+			return cloud;
+		}
+
+		double noise;
+		float frameRate;
+		std::vector<DynamicsConfiguration> dynamicsConfigurations;
+		std::vector<MarkerConfiguration> markerConfigurations;
+		std::vector<Object> objects;
+		std::vector<Eigen::Vector3f> homes;
+
+	private:
+		std::default_random_engine eng;
+		std::normal_distribution<float> gauss;
+	};
+
+} //namespace libobjecttracker